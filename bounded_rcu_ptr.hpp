@@ -0,0 +1,324 @@
+#pragma once
+
+#include <rcu_ptr.hpp>
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// An rcu_ptr with a cap on the versions which are alive at the same time.
+//
+// Readers which hold old versions for long (a long scan, a GC pause of an
+// embedded runtime) keep them alive while writers keep copying, which can
+// exhaust the memory with large snapshots. A bounded_rcu_ptr counts the live
+// versions, including the current one and those held by readers, and their
+// size in bytes. A writer reserves the next version before it copies the
+// current one; when that would exceed the limits it blocks until readers
+// release old versions, fails, or defers its update, according to the
+// overflow policy.
+
+enum class overflow_policy {
+    block,    // wait until a version is released
+    fail,     // throw version_limit_error
+    coalesce, // defer the update, it is applied with the next copy
+};
+
+// Thrown by the fail policy when the limits are reached.
+class version_limit_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+namespace detail {
+
+// The live versions and bytes of a bounded_rcu_ptr. Versions release their
+// share when they are destroyed, on whichever thread drops the last
+// reference.
+class version_budget {
+public:
+    version_budget(std::size_t max_versions, std::size_t max_bytes)
+        : max_versions(max_versions), max_bytes(max_bytes) {}
+
+    // Reserves a version of bytes, if it is within the limits. A version
+    // which is larger than max_bytes on its own fits if it is the only one.
+    bool try_acquire(std::size_t bytes) {
+        std::lock_guard<std::mutex> lock(mtx);
+        return acquire_locked(bytes);
+    }
+
+    // Reserves a version of bytes, waits until it is within the limits.
+    void acquire(std::size_t bytes) {
+        std::unique_lock<std::mutex> lock(mtx);
+        released.wait(lock, [&]() { return acquire_locked(bytes); });
+    }
+
+    // Reserves a version of bytes even if it exceeds the limits, for memory
+    // which exists already.
+    void add(std::size_t bytes) {
+        std::lock_guard<std::mutex> lock(mtx);
+        ++versions;
+        live_bytes += bytes;
+    }
+
+    // Corrects the size of a reserved version.
+    void resize(std::size_t from, std::size_t to) {
+        std::lock_guard<std::mutex> lock(mtx);
+        live_bytes = live_bytes - from + to;
+    }
+
+    void release(std::size_t bytes) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            --versions;
+            live_bytes -= bytes;
+        }
+        released.notify_all();
+    }
+
+    std::size_t live_versions() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return versions;
+    }
+
+    std::size_t bytes() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return live_bytes;
+    }
+
+private:
+    bool acquire_locked(std::size_t bytes) {
+        if (versions >= max_versions) return false;
+        std::size_t room = max_bytes - std::min(max_bytes, live_bytes);
+        if (versions > 0 && bytes > room) return false;
+        ++versions;
+        live_bytes += bytes;
+        return true;
+    }
+
+    const std::size_t max_versions;
+    const std::size_t max_bytes;
+    mutable std::mutex mtx;
+    std::condition_variable released;
+    std::size_t versions = 0;
+    std::size_t live_bytes = 0;
+};
+
+// An update deferred by the coalesce policy. Unlike std::function it takes
+// move-only callables, so that the updates of all policies may be.
+template <typename T>
+class deferred_update {
+    struct base {
+        virtual ~base() = default;
+        virtual void operator()(T* v) = 0;
+    };
+
+    template <typename F>
+    struct holder : base {
+        F f;
+        template <typename G>
+        explicit holder(G&& g) : f(std::forward<G>(g)) {}
+        void operator()(T* v) override { f(v); }
+    };
+
+    std::unique_ptr<base> fun;
+
+public:
+    template <typename F>
+    explicit deferred_update(F&& f)
+        : fun(new holder<std::decay_t<F> >(std::forward<F>(f))) {}
+
+    void operator()(T* v) { (*fun)(v); }
+};
+
+} // namespace detail
+
+template <typename T,
+          template <typename> class AtomicSharedPtr =
+              detail::__std::atomic_shared_ptr,
+          typename ASPTraits =
+              detail::atomic_shared_ptr_traits<AtomicSharedPtr> >
+class bounded_rcu_ptr {
+public:
+    template <typename _T>
+    using shared_ptr = typename ASPTraits::template shared_ptr<_T>;
+
+    struct limits {
+        // At least 2: the current version and the one being written.
+        std::size_t max_versions = std::numeric_limits<std::size_t>::max();
+        std::size_t max_bytes = std::numeric_limits<std::size_t>::max();
+        overflow_policy policy = overflow_policy::block;
+        // The size of a version, sizeof(T) if it is not set.
+        std::function<std::size_t(const T&)> size_of;
+    };
+
+private:
+    struct state {
+        shared_ptr<T> value;
+        std::size_t bytes = 0;
+        std::shared_ptr<detail::version_budget> budget;
+
+        state() = default;
+        state(const state&) = delete;
+        state& operator=(const state&) = delete;
+        ~state() {
+            if (budget) budget->release(bytes);
+        }
+    };
+
+    const limits lim;
+    std::shared_ptr<detail::version_budget> budget;
+    // Serializes the writers, so that they reserve and copy once per
+    // update.
+    std::mutex writer_mtx;
+    rcu_ptr<state, AtomicSharedPtr, ASPTraits, detail::single_writer> current;
+    std::vector<detail::deferred_update<T> > pending;
+
+    std::size_t size_of(const shared_ptr<T>& v) const {
+        if (!v) return 0;
+        return lim.size_of ? lim.size_of(*v) : sizeof(T);
+    }
+
+    // Publishes value, whose version is reserved with reserved bytes. The
+    // reservation is released if it throws before the state takes it over.
+    void publish(shared_ptr<T> value, std::size_t reserved) {
+        shared_ptr<state> s;
+        std::size_t bytes = 0;
+        try {
+            s = ASPTraits::template make_shared<state>();
+            bytes = size_of(value);
+        } catch (...) {
+            budget->release(reserved);
+            throw;
+        }
+        s->bytes = bytes;
+        s->value = std::move(value);
+        budget->resize(reserved, bytes);
+        s->budget = budget;
+        current.reset(std::move(s));
+    }
+
+    // Copies the current version, applies the pending updates and fun, and
+    // publishes the copy. The version is reserved with reserved bytes.
+    template <typename R>
+    void copy_and_publish(std::size_t reserved, R&& fun) {
+        shared_ptr<T> v;
+        try {
+            auto s = current.read();
+            if (s->value) v = detail::deep_copy<ASPTraits>(*s->value);
+            for (auto& p : pending) {
+                p(v.get());
+            }
+            pending.clear();
+            std::forward<R>(fun)(v.get());
+        } catch (...) {
+            budget->release(reserved);
+            throw;
+        }
+        publish(std::move(v), reserved);
+    }
+
+public:
+    // A version. It keeps its share of the limits until it is destroyed.
+    class snapshot {
+        shared_ptr<const state> s;
+
+        friend class bounded_rcu_ptr;
+        explicit snapshot(shared_ptr<const state> s) : s(std::move(s)) {}
+
+    public:
+        const T& operator*() const { return *s->value; }
+        const T* operator->() const { return s->value.get(); }
+        const T* get() const { return s->value.get(); }
+        explicit operator bool() const { return bool(s->value); }
+    };
+
+    // Throws std::invalid_argument if max_versions is less than 2.
+    explicit bounded_rcu_ptr(limits l, shared_ptr<T> initial = nullptr)
+        : lim(std::move(l)),
+          budget(std::make_shared<detail::version_budget>(lim.max_versions,
+                                                          lim.max_bytes)) {
+        if (lim.max_versions < 2) {
+            throw std::invalid_argument("bounded_rcu_ptr: max_versions < 2");
+        }
+        std::size_t bytes = size_of(initial);
+        budget->add(bytes);
+        publish(std::move(initial), bytes);
+    }
+
+    bounded_rcu_ptr(const bounded_rcu_ptr&) = delete;
+    bounded_rcu_ptr& operator=(const bounded_rcu_ptr&) = delete;
+
+    snapshot read() const { return snapshot(current.read()); }
+
+    // Publishes r. Its memory exists already, so it is counted even if it
+    // exceeds the limits. The pending updates are dropped.
+    void reset(shared_ptr<T> r) {
+        std::lock_guard<std::mutex> lock(writer_mtx);
+        pending.clear();
+        std::size_t bytes = size_of(r);
+        budget->add(bytes);
+        publish(std::move(r), bytes);
+    }
+
+    // Like rcu_ptr::copy_update. If the copy would exceed the limits:
+    //  - block: waits until readers release versions (a writer must not
+    //    hold a snapshot meanwhile),
+    //  - fail: throws version_limit_error,
+    //  - coalesce: keeps fun (a copy of it if it is an lvalue) and applies
+    //    it before the next update or flush which fits.
+    // Returns whether the update was published.
+    template <typename R>
+    bool copy_update(R&& fun) {
+        std::lock_guard<std::mutex> lock(writer_mtx);
+        std::size_t bytes = size_of(current.read()->value);
+        switch (lim.policy) {
+        case overflow_policy::block:
+            budget->acquire(bytes);
+            break;
+        case overflow_policy::fail:
+            if (!budget->try_acquire(bytes)) {
+                throw version_limit_error(
+                    "bounded_rcu_ptr: version limit reached");
+            }
+            break;
+        case overflow_policy::coalesce:
+            if (!budget->try_acquire(bytes)) {
+                pending.emplace_back(std::forward<R>(fun));
+                return false;
+            }
+            break;
+        }
+        copy_and_publish(bytes, std::forward<R>(fun));
+        return true;
+    }
+
+    // Publishes the pending updates of the coalesce policy, waiting until
+    // they fit. Returns whether there were any.
+    bool flush() {
+        std::lock_guard<std::mutex> lock(writer_mtx);
+        if (pending.empty()) return false;
+        std::size_t bytes = size_of(current.read()->value);
+        budget->acquire(bytes);
+        copy_and_publish(bytes, [](T*) {});
+        return true;
+    }
+
+    // The number of versions which are alive, including the current one.
+    std::size_t live_versions() const { return budget->live_versions(); }
+
+    // The size of the versions which are alive.
+    std::size_t live_bytes() const { return budget->bytes(); }
+
+    // The number of updates deferred by the coalesce policy.
+    std::size_t pending_updates() {
+        std::lock_guard<std::mutex> lock(writer_mtx);
+        return pending.size();
+    }
+};
@@ -0,0 +1,269 @@
+#pragma once
+
+#include <rcu_ptr.hpp>
+#include <detail/errno_error.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Checkpointing of rcu_ptr versions to disk (Linux).
+//
+// A version read from an rcu_ptr is immutable, so it can be serialized while
+// writers keep publishing new versions; the checkpoint holds the version
+// until it is written. The file is written through a large aligned buffer,
+// with O_DIRECT if the file system supports it so that checkpoints do not
+// evict the page cache, to a temporary file which is renamed over the
+// target once it is complete and synced.
+
+struct checkpoint_options {
+    // Bypass the page cache if the file system supports it.
+    bool direct_io = true;
+    // Size of the write buffer, rounded up to a multiple of the block size.
+    std::size_t buffer_size = std::size_t(1) << 20;
+};
+
+struct checkpoint_stats {
+    std::size_t bytes = 0;
+    std::chrono::nanoseconds duration{0};
+    bool direct_io = false;
+
+    // In bytes per second.
+    double throughput() const {
+        return duration.count() > 0 ? bytes * 1e9 / duration.count() : 0;
+    }
+};
+
+// The sink a serializer writes to.
+class checkpoint_writer {
+public:
+    static constexpr std::size_t block_size = 4096;
+
+    // Opens a temporary file next to path. Throws std::system_error.
+    checkpoint_writer(std::string path, const checkpoint_options& options)
+        : path(std::move(path)), tmp(this->path + ".tmp") {
+        capacity = (options.buffer_size + block_size - 1) / block_size *
+                   block_size;
+        if (capacity == 0) capacity = block_size;
+        void* p = nullptr;
+        if (::posix_memalign(&p, block_size, capacity) != 0) {
+            throw std::bad_alloc();
+        }
+        buffer.reset(static_cast<char*>(p));
+
+        const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        if (options.direct_io) {
+            fd = ::open(tmp.c_str(), flags | O_DIRECT, 0644);
+            direct = fd >= 0;
+        }
+        // Not every file system supports O_DIRECT (e.g. tmpfs).
+        if (fd < 0) fd = ::open(tmp.c_str(), flags, 0644);
+        if (fd < 0) throw detail::errno_error("open " + tmp);
+    }
+
+    checkpoint_writer(const checkpoint_writer&) = delete;
+    checkpoint_writer& operator=(const checkpoint_writer&) = delete;
+
+    ~checkpoint_writer() {
+        if (fd >= 0) {
+            ::close(fd);
+            ::unlink(tmp.c_str());
+        }
+    }
+
+    void write(const void* data, std::size_t n) {
+        const char* p = static_cast<const char*>(data);
+        while (n > 0) {
+            std::size_t chunk = std::min(n, capacity - used);
+            std::memcpy(buffer.get() + used, p, chunk);
+            used += chunk;
+            p += chunk;
+            n -= chunk;
+            if (used == capacity) flush_buffer(capacity);
+        }
+    }
+
+    template <typename U>
+    void write_value(const U& value) {
+        static_assert(std::is_trivially_copyable<U>::value,
+                      "only trivially copyable values can be written raw");
+        write(&value, sizeof(value));
+    }
+
+    std::size_t bytes_written() const { return flushed + used; }
+    bool direct_io() const { return direct; }
+
+    // Writes the rest of the buffer, syncs the file and renames it over the
+    // target.
+    void commit() {
+        std::size_t size = bytes_written();
+        if (used > 0) {
+            // O_DIRECT writes whole blocks, the padding is cut off below.
+            std::size_t padded = direct ? (used + block_size - 1) /
+                                              block_size * block_size
+                                        : used;
+            std::memset(buffer.get() + used, 0, padded - used);
+            flush_buffer(padded);
+        }
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            throw detail::errno_error("ftruncate " + tmp);
+        }
+        if (::fsync(fd) != 0) throw detail::errno_error("fsync " + tmp);
+        if (::close(fd) != 0) {
+            fd = -1;
+            throw detail::errno_error("close " + tmp);
+        }
+        fd = -1;
+        if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+            auto error = detail::errno_error("rename " + tmp);
+            ::unlink(tmp.c_str());
+            throw error;
+        }
+    }
+
+private:
+    void flush_buffer(std::size_t n) {
+        const char* p = buffer.get();
+        std::size_t left = n;
+        while (left > 0) {
+            ssize_t written = ::write(fd, p, left);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                throw detail::errno_error("write " + tmp);
+            }
+            p += written;
+            left -= static_cast<std::size_t>(written);
+        }
+        flushed += used;
+        used = 0;
+    }
+
+    struct free_deleter {
+        void operator()(char* p) const { std::free(p); }
+    };
+
+    const std::string path;
+    const std::string tmp;
+    std::unique_ptr<char, free_deleter> buffer;
+    std::size_t capacity = 0;
+    std::size_t used = 0;
+    std::size_t flushed = 0;
+    int fd = -1;
+    bool direct = false;
+};
+
+// Serializes value to path with serialize(const T&, checkpoint_writer&).
+// Throws what the serializer or the writer throws.
+template <typename T, typename Serializer>
+checkpoint_stats write_checkpoint(const T& value, const std::string& path,
+                                  Serializer&& serialize,
+                                  const checkpoint_options& options =
+                                      checkpoint_options()) {
+    auto start = std::chrono::steady_clock::now();
+    checkpoint_writer writer(path, options);
+    std::forward<Serializer>(serialize)(value, writer);
+    writer.commit();
+    checkpoint_stats stats;
+    stats.bytes = writer.bytes_written();
+    stats.direct_io = writer.direct_io();
+    stats.duration = std::chrono::steady_clock::now() - start;
+    return stats;
+}
+
+// Writes checkpoints of the current version of an rcu_ptr on a background
+// thread, one at a time.
+template <typename T,
+          template <typename> class AtomicSharedPtr =
+              detail::__std::atomic_shared_ptr,
+          typename ASPTraits =
+              detail::atomic_shared_ptr_traits<AtomicSharedPtr> >
+class checkpointer {
+public:
+    using rcu_ptr_type = rcu_ptr<T, AtomicSharedPtr, ASPTraits>;
+    using serializer = std::function<void(const T&, checkpoint_writer&)>;
+
+    checkpointer(const rcu_ptr_type& source, serializer serialize,
+                 checkpoint_options options = checkpoint_options())
+        : source(source), serialize(std::move(serialize)), options(options) {}
+
+    checkpointer(const checkpointer&) = delete;
+    checkpointer& operator=(const checkpointer&) = delete;
+
+    ~checkpointer() {
+        if (worker.joinable()) worker.join();
+    }
+
+    // Starts writing the version which is current now. Returns false if a
+    // checkpoint is still running.
+    bool start(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (busy) return false;
+        if (worker.joinable()) worker.join();
+        busy = true;
+        error = nullptr;
+        auto snapshot = source.read();
+        worker = std::thread([this, path, snapshot]() {
+            checkpoint_stats stats;
+            std::exception_ptr e;
+            try {
+                if (snapshot) {
+                    stats = write_checkpoint(*snapshot, path, serialize,
+                                             options);
+                }
+            } catch (...) {
+                e = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(mtx);
+            last = stats;
+            error = e;
+            busy = false;
+        });
+        return true;
+    }
+
+    bool running() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return busy;
+    }
+
+    // Waits for the last checkpoint and returns its stats. Rethrows its
+    // error, if it failed.
+    checkpoint_stats wait() {
+        std::unique_lock<std::mutex> lock(mtx);
+        if (worker.joinable()) {
+            std::thread t = std::move(worker);
+            lock.unlock();
+            t.join();
+            lock.lock();
+        }
+        if (error) std::rethrow_exception(error);
+        return last;
+    }
+
+private:
+    const rcu_ptr_type& source;
+    const serializer serialize;
+    const checkpoint_options options;
+
+    mutable std::mutex mtx;
+    bool busy = false;
+    checkpoint_stats last;
+    std::exception_ptr error;
+    std::thread worker;
+};
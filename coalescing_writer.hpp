@@ -0,0 +1,97 @@
+#pragma once
+
+#include <rcu_ptr.hpp>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <utility>
+
+// A writer of an rcu_ptr which publishes its updates in batches.
+//
+// Feeds which update an rcu_ptr many thousand times per second, while the
+// readers only need data which is a few milliseconds fresh, pay for a deep
+// copy, an allocation and a publication per update. A coalescing_writer
+// applies the updates to a private staging copy instead, and publishes it
+// at most once per interval, or when max_batch updates are staged. The
+// staging copy is made once per publication.
+//
+// Updates are published by update, flush_if_due and flush only: a writer
+// which stops updating should call flush (or flush_if_due from a timer), the
+// destructor flushes too. The coalescing_writer must be the only writer of
+// the rcu_ptr, since a publication replaces the current version as reset
+// does. It is used by one thread at a time.
+template <typename T,
+          template <typename> class AtomicSharedPtr =
+              detail::__std::atomic_shared_ptr,
+          typename ASPTraits =
+              detail::atomic_shared_ptr_traits<AtomicSharedPtr>,
+          typename WritePolicy = detail::multi_writer>
+class coalescing_writer {
+public:
+    template <typename _T>
+    using shared_ptr = typename ASPTraits::template shared_ptr<_T>;
+    using rcu_ptr_type = rcu_ptr<T, AtomicSharedPtr, ASPTraits, WritePolicy>;
+    using clock = std::chrono::steady_clock;
+
+private:
+    rcu_ptr_type& target;
+    const clock::duration interval;
+    const std::size_t max_batch;
+    shared_ptr<T> staging;
+    // The number of updates in staging.
+    std::size_t staged = 0;
+    clock::time_point last_publication;
+
+public:
+    // Publishes when interval has passed since the last publication, or
+    // when max_batch updates are staged, whichever comes first.
+    coalescing_writer(
+        rcu_ptr_type& target, clock::duration interval,
+        std::size_t max_batch = std::numeric_limits<std::size_t>::max())
+        : target(target),
+          interval(interval),
+          max_batch(max_batch),
+          last_publication(clock::now()) {}
+
+    coalescing_writer(const coalescing_writer&) = delete;
+    coalescing_writer& operator=(const coalescing_writer&) = delete;
+
+    ~coalescing_writer() { flush(); }
+
+    // Like rcu_ptr::copy_update, fun(T*) modifies the staging copy, which
+    // starts as a copy of the current version (nullptr if it is null).
+    // Returns whether the update was published.
+    template <typename R>
+    bool update(R&& fun) {
+        if (staged == 0) {
+            auto current = target.read();
+            if (current) staging = detail::deep_copy<ASPTraits>(*current);
+        }
+        std::forward<R>(fun)(staging.get());
+        ++staged;
+        return flush_if_due();
+    }
+
+    // Publishes the staged updates if the interval has passed or the batch
+    // is full. Returns whether it published.
+    bool flush_if_due() {
+        if (staged == 0) return false;
+        if (staged < max_batch && clock::now() - last_publication < interval) {
+            return false;
+        }
+        return flush();
+    }
+
+    // Publishes the staged updates now. Returns whether there were any.
+    bool flush() {
+        if (staged == 0) return false;
+        target.reset(std::move(staging));
+        staging = nullptr;
+        staged = 0;
+        last_publication = clock::now();
+        return true;
+    }
+
+    // The number of updates which are not published yet.
+    std::size_t pending() const { return staged; }
+};
@@ -0,0 +1,372 @@
+#pragma once
+
+#include <detail/errno_error.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Arrays of trivially copyable records whose versions share their unmodified
+// pages (Linux only).
+//
+// The records live in a memfd which is divided into blocks of the page
+// size. A version maps its blocks into one contiguous read-only view, so
+// readers get a plain `const T*`. Copying a version, as the deep copy of
+// rcu_ptr::copy_update does, shares all blocks with the original and copies
+// no records; writing a record through either version gives the writer a
+// private block for the pages of the record first. An update of a few
+// records of a multi-GB array copies a few pages instead of the whole array.
+//
+// A copy costs one mmap per run of consecutive blocks and a reference count
+// update per block. When scattered writes have split a version into more
+// than max_runs runs, the next copy is a full copy into consecutive blocks,
+// which bounds the number of mappings.
+
+namespace detail {
+
+// A memfd of blocks of the page size with a reference count per block. It is
+// shared by all versions of a cow_array.
+class cow_block_file {
+public:
+    cow_block_file() {
+        fd = ::memfd_create("cow_array", MFD_CLOEXEC);
+        if (fd < 0) throw errno_error("memfd_create");
+    }
+
+    cow_block_file(const cow_block_file&) = delete;
+    cow_block_file& operator=(const cow_block_file&) = delete;
+
+    ~cow_block_file() { ::close(fd); }
+
+    static std::size_t block_size() {
+        static const std::size_t size =
+            static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        return size;
+    }
+
+    int descriptor() const { return fd; }
+
+    // Returns the first of n consecutive new blocks. Free blocks are reused:
+    // a run of n consecutive ones, or the run at the end of the file, which
+    // the file is extended from.
+    std::size_t allocate(std::size_t n) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (n == 1 && !free_blocks.empty()) {
+            std::size_t b = free_blocks.back();
+            free_blocks.pop_back();
+            refs[b] = 1;
+            return b;
+        }
+        std::size_t first = take_free_run(n);
+        if (first + n > capacity) {
+            std::size_t c = std::max(capacity * 2, first + n);
+            if (::ftruncate(fd, static_cast<off_t>(c * block_size())) != 0) {
+                throw errno_error("ftruncate memfd");
+            }
+            capacity = c;
+        }
+        if (first + n > refs.size()) refs.resize(first + n, 1);
+        return first;
+    }
+
+    void acquire(const std::vector<std::size_t>& blocks) {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (std::size_t b : blocks) {
+            ++refs[b];
+        }
+    }
+
+    // Whether another version holds block b too.
+    bool shared(std::size_t b) const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return refs[b] > 1;
+    }
+
+    void release(std::size_t b) {
+        std::lock_guard<std::mutex> lock(mtx);
+        release_locked(b);
+    }
+
+    void release(const std::vector<std::size_t>& blocks) {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (std::size_t b : blocks) {
+            release_locked(b);
+        }
+    }
+
+    // The number of blocks which are in use.
+    std::size_t used_blocks() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return refs.size() - free_blocks.size();
+    }
+
+    // The number of blocks the file has room for, used or not.
+    std::size_t capacity_blocks() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return capacity;
+    }
+
+private:
+    // Takes the first run of n consecutive free blocks, or else the run of
+    // free blocks at the end of the file, and returns its first block.
+    // Returns refs.size() if there is neither. Multi-block allocations are
+    // rare (a new array and the compacting copy), so the free blocks are
+    // sorted here rather than kept in order by release.
+    std::size_t take_free_run(std::size_t n) {
+        if (free_blocks.empty()) return refs.size();
+        std::sort(free_blocks.begin(), free_blocks.end());
+        std::size_t begin = 0;
+        std::size_t end = 1;
+        for (; end <= free_blocks.size(); ++end) {
+            if (end < free_blocks.size() &&
+                free_blocks[end] == free_blocks[end - 1] + 1) {
+                continue;
+            }
+            if (end - begin >= n) {
+                end = begin + n;
+                break;
+            }
+            if (end == free_blocks.size()) {
+                // The last run, reusable if it ends the file.
+                if (free_blocks.back() + 1 != refs.size()) {
+                    return refs.size();
+                }
+                break;
+            }
+            begin = end;
+        }
+        std::size_t first = free_blocks[begin];
+        for (std::size_t i = begin; i < end; ++i) {
+            refs[free_blocks[i]] = 1;
+        }
+        free_blocks.erase(free_blocks.begin() + static_cast<long>(begin),
+                          free_blocks.begin() + static_cast<long>(end));
+        return first;
+    }
+
+    void release_locked(std::size_t b) {
+        if (--refs[b] > 0) return;
+        // Give the memory back, the block reads as zeros until it is reused.
+        ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    static_cast<off_t>(b * block_size()),
+                    static_cast<off_t>(block_size()));
+        free_blocks.push_back(b);
+    }
+
+    int fd;
+    mutable std::mutex mtx;
+    std::vector<std::size_t> refs;
+    std::vector<std::size_t> free_blocks;
+    std::size_t capacity = 0;
+};
+
+} // namespace detail
+
+template <typename T>
+class cow_array {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "records are copied page by page, they must be trivially "
+                  "copyable");
+
+public:
+    static constexpr std::size_t max_runs = 1024;
+
+    using value_type = T;
+    using const_iterator = const T*;
+
+    // Throws std::system_error if the memory can not be mapped.
+    explicit cow_array(std::size_t size, const T& value = T())
+        : file(std::make_shared<detail::cow_block_file>()), count(size) {
+        std::size_t n = block_count();
+        if (n == 0) return;
+        std::size_t first = file->allocate(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            blocks.push_back(first + i);
+        }
+        owned.assign(n, true);
+        map_view();
+        for (std::size_t i = 0; i < count; ++i) {
+            std::memcpy(view + i * sizeof(T), &value, sizeof(T));
+        }
+    }
+
+    // Shares the blocks of other, which are copied when either version
+    // writes them.
+    cow_array(const cow_array& other)
+        : file(other.file), count(other.count), blocks(other.blocks) {
+        if (blocks.empty()) return;
+        if (other.runs() > max_runs) {
+            // Too fragmented, copy into consecutive blocks.
+            std::size_t first = file->allocate(blocks.size());
+            for (std::size_t i = 0; i < blocks.size(); ++i) {
+                blocks[i] = first + i;
+            }
+            owned.assign(blocks.size(), true);
+        } else {
+            file->acquire(blocks);
+            owned.assign(blocks.size(), false);
+        }
+        try {
+            map_view();
+        } catch (...) {
+            file->release(blocks);
+            throw;
+        }
+        if (owned.front()) std::memcpy(view, other.view, length());
+    }
+
+    cow_array& operator=(const cow_array&) = delete;
+
+    ~cow_array() {
+        if (view) ::munmap(view, length());
+        file->release(blocks);
+    }
+
+    const T* data() const { return reinterpret_cast<const T*>(view); }
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T& operator[](std::size_t i) const { return data()[i]; }
+    const_iterator begin() const { return data(); }
+    const_iterator end() const { return data() + count; }
+
+    // Returns the records [first, first + n) for writing. The blocks which
+    // hold them are copied first, unless this version has its own already.
+    // Throws std::system_error.
+    T* write(std::size_t first, std::size_t n) {
+        if (n > 0) {
+            std::size_t bs = detail::cow_block_file::block_size();
+            std::size_t last = ((first + n) * sizeof(T) - 1) / bs;
+            for (std::size_t b = first * sizeof(T) / bs; b <= last; ++b) {
+                own(b);
+            }
+        }
+        return reinterpret_cast<T*>(view) + first;
+    }
+
+    T& write(std::size_t i) { return *write(i, 1); }
+
+    // The number of blocks which this version does not share.
+    std::size_t owned_blocks() const {
+        std::size_t n = 0;
+        for (std::size_t b : blocks) {
+            n += !file->shared(b);
+        }
+        return n;
+    }
+
+    // The number of blocks of the file which all versions share, used or
+    // free.
+    std::size_t file_blocks() const { return file->capacity_blocks(); }
+
+private:
+    std::size_t block_count() const {
+        std::size_t bs = detail::cow_block_file::block_size();
+        return (count * sizeof(T) + bs - 1) / bs;
+    }
+
+    std::size_t length() const {
+        return blocks.size() * detail::cow_block_file::block_size();
+    }
+
+    off_t offset(std::size_t block) const {
+        return static_cast<off_t>(block *
+                                  detail::cow_block_file::block_size());
+    }
+
+    // The number of runs of consecutive blocks.
+    std::size_t runs() const {
+        std::size_t r = 0;
+        for (std::size_t i = 0; i < blocks.size(); ++i) {
+            if (i == 0 || blocks[i] != blocks[i - 1] + 1 ||
+                owned[i] != owned[i - 1]) {
+                ++r;
+            }
+        }
+        return r;
+    }
+
+    // Maps the blocks into a new view, each run with one mapping. Owned
+    // blocks are writable.
+    void map_view() {
+        void* p = ::mmap(nullptr, length(), PROT_NONE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw detail::errno_error("mmap");
+        view = static_cast<char*>(p);
+        std::size_t bs = detail::cow_block_file::block_size();
+        for (std::size_t i = 0; i < blocks.size();) {
+            std::size_t j = i + 1;
+            while (j < blocks.size() && blocks[j] == blocks[j - 1] + 1 &&
+                   owned[j] == owned[i]) {
+                ++j;
+            }
+            if (!map(view + i * bs, (j - i) * bs, blocks[i], owned[i])) {
+                auto error = detail::errno_error("mmap memfd");
+                ::munmap(view, length());
+                view = nullptr;
+                throw error;
+            }
+            i = j;
+        }
+    }
+
+    bool map(char* at, std::size_t len, std::size_t block, bool writable) {
+        int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+        return ::mmap(at, len, prot, MAP_SHARED | MAP_FIXED,
+                      file->descriptor(), offset(block)) != MAP_FAILED;
+    }
+
+    // Makes block b of the view private and writable. The reference count
+    // decides, not owned: a copy of this version shares the blocks which
+    // this version has mapped writable already. A block which no other
+    // version holds any more is remapped writable, a shared one is replaced
+    // by a private copy.
+    void own(std::size_t b) {
+        std::size_t bs = detail::cow_block_file::block_size();
+        if (!file->shared(blocks[b])) {
+            if (owned[b]) return;
+            if (!map(view + b * bs, bs, blocks[b], true)) {
+                throw detail::errno_error("mmap memfd");
+            }
+            owned[b] = true;
+            return;
+        }
+        std::size_t copy = file->allocate(1);
+        const char* src = view + b * bs;
+        for (std::size_t done = 0; done < bs;) {
+            ssize_t w = ::pwrite(file->descriptor(), src + done, bs - done,
+                                 offset(copy) + static_cast<off_t>(done));
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                auto error = detail::errno_error("pwrite memfd");
+                file->release(copy);
+                throw error;
+            }
+            done += static_cast<std::size_t>(w);
+        }
+        if (!map(view + b * bs, bs, copy, true)) {
+            auto error = detail::errno_error("mmap memfd");
+            file->release(copy);
+            throw error;
+        }
+        file->release(blocks[b]);
+        blocks[b] = copy;
+        owned[b] = true;
+    }
+
+    std::shared_ptr<detail::cow_block_file> file;
+    std::size_t count = 0;
+    // The block of the file for each block of the view.
+    std::vector<std::size_t> blocks;
+    // Whether the block is mapped writable. A copy of this version may share
+    // it since.
+    std::vector<bool> owned;
+    char* view = nullptr;
+};
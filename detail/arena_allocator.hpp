@@ -0,0 +1,118 @@
+// arena_allocator.hpp
+//
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+namespace detail { namespace arena {
+
+// Hands out memory from a list of growing chunks and frees it only when it
+// is destroyed, like std::pmr::monotonic_buffer_resource. It is not
+// thread-safe: a version is filled by the writer which creates it, and is
+// immutable once it is published.
+class monotonic_arena {
+    struct chunk {
+        chunk* prev;
+    };
+
+    chunk* head = nullptr;
+    char* cur = nullptr;
+    char* end = nullptr;
+    std::size_t next_size;
+    std::size_t used_bytes = 0;
+
+public:
+    explicit monotonic_arena(std::size_t initial_size = 4096)
+        : next_size(std::max<std::size_t>(initial_size, 256)) {}
+
+    monotonic_arena(const monotonic_arena&) = delete;
+    monotonic_arena& operator=(const monotonic_arena&) = delete;
+
+    ~monotonic_arena() {
+        while (head) {
+            chunk* prev = head->prev;
+            ::operator delete(head);
+            head = prev;
+        }
+    }
+
+    void* allocate(std::size_t bytes, std::size_t alignment) {
+        auto aligned = [alignment](char* p) {
+            auto a = reinterpret_cast<std::uintptr_t>(p);
+            return reinterpret_cast<char*>((a + alignment - 1) &
+                                           ~(alignment - 1));
+        };
+        char* p = aligned(cur);
+        if (!cur || p + bytes > end) {
+            std::size_t size = std::max(next_size, sizeof(chunk) + alignment +
+                                                       bytes);
+            auto* c = static_cast<chunk*>(::operator new(size));
+            c->prev = head;
+            head = c;
+            cur = reinterpret_cast<char*>(c + 1);
+            end = reinterpret_cast<char*>(c) + size;
+            next_size = size * 2;
+            p = aligned(cur);
+        }
+        used_bytes += p + bytes - cur;
+        cur = p + bytes;
+        return p;
+    }
+
+    // The bytes handed out so far, a size hint for an arena of a copy.
+    std::size_t used() const { return used_bytes; }
+};
+
+// Allocates from a monotonic_arena, deallocation is a no-op. A default
+// constructed allocator has no arena and uses the global heap.
+//
+// A copy constructed container does not inherit the arena of the original,
+// because it may outlive it; pass an allocator to the copy constructor to
+// place the copy in an arena.
+template <typename T>
+class allocator {
+    monotonic_arena* a = nullptr;
+
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::false_type;
+    using propagate_on_container_swap = std::false_type;
+
+    allocator() noexcept = default;
+    explicit allocator(monotonic_arena* a) noexcept : a(a) {}
+    template <typename U>
+    allocator(const allocator<U>& other) noexcept : a(other.arena()) {}
+
+    T* allocate(std::size_t n) {
+        if (!a) return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(a->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept {
+        if (!a) ::operator delete(p);
+    }
+
+    allocator select_on_container_copy_construction() const {
+        return allocator();
+    }
+
+    monotonic_arena* arena() const noexcept { return a; }
+};
+
+template <typename T, typename U>
+bool operator==(const allocator<T>& lhs, const allocator<U>& rhs) noexcept {
+    return lhs.arena() == rhs.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const allocator<T>& lhs, const allocator<U>& rhs) noexcept {
+    return !(lhs == rhs);
+}
+
+} // namespace arena
+} // namespace detail
@@ -0,0 +1,91 @@
+// arena_atomic_shared_ptr_traits.hpp
+//
+#pragma once
+#include <detail/arena_allocator.hpp>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace detail { namespace arena {
+
+// Traits for an atomic_shared_ptr of std::shared_ptr (e.g. the default
+// detail::__std backend) which give every version of an allocator-aware type
+// its own monotonic_arena.
+//
+// make_shared constructs types which use detail::arena::allocator in a new
+// arena, passing the allocator to their constructor, so the deep copy of
+// rcu_ptr::copy_update is laid out contiguously with one allocation per
+// chunk. The arena is sized after the arena of the version it is copied
+// from, and it is freed at once when the version is destroyed. Other types
+// are allocated with std::make_shared.
+template <template <typename> class AtomicSharedPtr>
+struct atomic_shared_ptr_traits {
+    template <typename T>
+    using atomic_shared_ptr = AtomicSharedPtr<T>;
+
+    template <typename T>
+    using shared_ptr = std::shared_ptr<T>;
+
+    template <typename T, typename... Args>
+    static auto make_shared(Args&&... args) {
+        return make<T>(std::uses_allocator<T, allocator<char> >(),
+                       std::forward<Args>(args)...);
+    }
+
+private:
+    struct deleter {
+        monotonic_arena* a;
+        template <typename T>
+        void operator()(T* p) const {
+            p->~T();
+            delete a;
+        }
+    };
+
+    template <typename U>
+    static auto size_hint(int, const U& source)
+        -> decltype(source.get_allocator().arena(), std::size_t()) {
+        auto* a = source.get_allocator().arena();
+        return a ? a->used() : 0;
+    }
+
+    template <typename... Args>
+    static std::size_t size_hint(long, const Args&...) {
+        return 0;
+    }
+
+    template <typename T, typename... Args>
+    static std::shared_ptr<T> make(std::false_type, Args&&... args) {
+        return std::make_shared<T>(std::forward<Args>(args)...);
+    }
+
+    template <typename T, typename... Args>
+    static std::shared_ptr<T> make(std::true_type, Args&&... args) {
+        std::unique_ptr<monotonic_arena> a(
+            new monotonic_arena(size_hint(0, args...)));
+        void* p = a->allocate(sizeof(T), alignof(T));
+        T* t = construct<T>(
+            p, allocator<char>(a.get()),
+            std::is_constructible<T, Args&&..., const allocator<char>&>(),
+            std::forward<Args>(args)...);
+        return std::shared_ptr<T>(t, deleter{a.release()});
+    }
+
+    // The allocator is the last argument.
+    template <typename T, typename... Args>
+    static T* construct(void* p, const allocator<char>& alloc, std::true_type,
+                        Args&&... args) {
+        return ::new (p) T(std::forward<Args>(args)..., alloc);
+    }
+
+    // The allocator is the first argument, after std::allocator_arg.
+    template <typename T, typename... Args>
+    static T* construct(void* p, const allocator<char>& alloc,
+                        std::false_type, Args&&... args) {
+        return ::new (p) T(std::allocator_arg, alloc,
+                           std::forward<Args>(args)...);
+    }
+};
+
+} // namespace arena
+} // namespace detail
@@ -1,6 +1,7 @@
 // atomic_shared_ptr_traits.hpp
 //
 #pragma once
+#include <detail/default_init_allocator.hpp>
 #include <memory>
 
 namespace detail {
@@ -17,6 +18,12 @@ struct atomic_shared_ptr_traits
   template< typename T, typename... Args >
   static auto make_shared(Args &&...args)
   { return std::make_shared<T>(std::forward<Args>(args)...); }
+
+  // Like make_shared<T>(), but a trivially constructible T is left
+  // uninitialized.
+  template< typename T >
+  static auto make_shared_for_overwrite()
+  { return std::allocate_shared<T>(default_init_allocator<T>()); }
 };
 
 } // namespace detail
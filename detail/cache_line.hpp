@@ -0,0 +1,44 @@
+// cache_line.hpp
+//
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace detail {
+
+// Size of a cache line on the platforms we target (x86-64 and most ARMv8).
+constexpr std::size_t cache_line_size = 64;
+
+// Aligns T to a cache line and pads it to a multiple of one, so that
+// neighbouring elements of an array of padded<T> do not share a cache line.
+//
+// The alignment holds for static and automatic objects and members, but
+// before C++17 operator new aligns to alignof(std::max_align_t) only: a
+// class with padded members which is allocated with new derives from
+// cache_aligned. std::make_shared and std::allocator do not use the class
+// allocation functions, such objects need aligned storage.
+template <typename T>
+struct alignas(cache_line_size) padded {
+    T value{};
+};
+
+// Class allocation functions which place the object on a cache line
+// boundary.
+struct cache_aligned {
+    static void* operator new(std::size_t size) { return allocate(size); }
+    static void* operator new[](std::size_t size) { return allocate(size); }
+    static void operator delete(void* p) noexcept { std::free(p); }
+    static void operator delete[](void* p) noexcept { std::free(p); }
+
+private:
+    static void* allocate(std::size_t size) {
+        void* p = nullptr;
+        if (::posix_memalign(&p, cache_line_size, size) != 0) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+};
+
+} // namespace detail
@@ -0,0 +1,114 @@
+// deep_copy.hpp
+//
+#pragma once
+
+#include <detail/default_init_allocator.hpp>
+#include <detail/stream_copy.hpp>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace detail {
+
+// Makes the name known to unqualified lookup, the overloads for user types
+// are found by argument dependent lookup.
+void rcu_clone();
+
+// Whether T has an rcu_clone customization: a function
+//   T rcu_clone(const T&)
+// in the namespace of T, which is found by argument dependent lookup.
+template <typename T, typename = void>
+struct has_rcu_clone : std::false_type {};
+
+template <typename T>
+struct has_rcu_clone<
+    T, std::enable_if_t<std::is_same<
+           decltype(rcu_clone(std::declval<const T&>())), T>::value> >
+    : std::true_type {};
+
+// Whether a value of T is copied with stream_copy: trivially copyable values
+// of at least stream_copy_threshold bytes, and vectors of trivially copyable
+// elements which use a default_init_allocator (at run time, if they hold at
+// least stream_copy_threshold bytes). The copy is streamed into a default
+// initialized object, so T must be default constructible too, other types
+// are copy constructed.
+template <typename T>
+struct is_stream_copyable
+    : std::integral_constant<bool,
+                             std::is_trivially_copyable<T>::value &&
+                                 std::is_default_constructible<T>::value &&
+                                 sizeof(T) >= stream_copy_threshold> {};
+
+template <typename T, typename A>
+struct is_stream_copyable<std::vector<T, default_init_allocator<T, A> > >
+    : std::integral_constant<bool,
+                             std::is_trivially_copyable<T>::value &&
+                                 std::is_default_constructible<T>::value> {};
+
+// ASPTraits::make_shared_for_overwrite<T>() if the traits provide it,
+// ASPTraits::make_shared<T>() otherwise.
+template <typename T, typename ASPTraits>
+auto make_shared_for_overwrite(int)
+    -> decltype(ASPTraits::template make_shared_for_overwrite<T>()) {
+    return ASPTraits::template make_shared_for_overwrite<T>();
+}
+
+template <typename T, typename ASPTraits>
+auto make_shared_for_overwrite(long) {
+    return ASPTraits::template make_shared<T>();
+}
+
+template <typename ASPTraits, typename T>
+auto copy_construct(const T& value, std::true_type) {
+    return ASPTraits::template make_shared<T>(rcu_clone(value));
+}
+
+template <typename ASPTraits, typename T>
+auto copy_construct(const T& value, std::false_type) {
+    return ASPTraits::template make_shared<T>(value);
+}
+
+template <typename ASPTraits, typename T>
+auto deep_copy(const T& value, std::false_type) {
+    return copy_construct<ASPTraits>(value, has_rcu_clone<T>());
+}
+
+template <typename ASPTraits, typename T>
+auto deep_copy(const T& value, std::true_type) {
+    auto copy = make_shared_for_overwrite<T, ASPTraits>(0);
+    stream_copy(copy.get(), std::addressof(value), sizeof(T));
+    return copy;
+}
+
+template <typename ASPTraits, typename T, typename A>
+auto deep_copy(const std::vector<T, default_init_allocator<T, A> >& value,
+               std::true_type) {
+    using V = std::vector<T, default_init_allocator<T, A> >;
+    if (value.size() * sizeof(T) < stream_copy_threshold) {
+        return ASPTraits::template make_shared<V>(value);
+    }
+    auto copy = ASPTraits::template make_shared<V>();
+    copy->resize(value.size()); // uninitialized
+    stream_copy(copy->data(), value.data(), value.size() * sizeof(T));
+    return copy;
+}
+
+// Returns a copy of value made by ASPTraits, the deep copy of copy_update.
+//
+// If T has an rcu_clone customization, the copy is move constructed from
+// what it returns. A type can return a shallow copy there, which shares its
+// large unchanged members (e.g. through shared_ptr<const U>) with value, so
+// the cost of copy_update scales with what the update changes.
+//
+// Values which are stream copyable are copied into uninitialized memory with
+// non-temporal stores, so that a writer copying a large snapshot neither
+// zeroes it first nor evicts the data of the readers from the caches it
+// shares with them. Other values are copy constructed.
+template <typename ASPTraits, typename T>
+auto deep_copy(const T& value) {
+    return deep_copy<ASPTraits>(
+        value, std::integral_constant<bool, is_stream_copyable<T>::value &&
+                                                !has_rcu_clone<T>::value>());
+}
+
+} // namespace detail
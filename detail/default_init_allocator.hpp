@@ -0,0 +1,42 @@
+// default_init_allocator.hpp
+//
+#pragma once
+
+#include <memory>
+#include <utility>
+
+namespace detail {
+
+// An allocator which default-initializes the objects it constructs without
+// arguments, so they are not zeroed before they are overwritten: a vector
+// using it leaves trivially constructible elements uninitialized on resize,
+// and allocate_shared leaves a trivially constructible object uninitialized.
+// The memory is allocated by A, e.g. a huge_page_allocator.
+template <typename T, typename A = std::allocator<T> >
+class default_init_allocator : public A {
+    using a_traits = std::allocator_traits<A>;
+
+public:
+    template <typename U>
+    struct rebind {
+        using other = default_init_allocator<
+            U, typename a_traits::template rebind_alloc<U> >;
+    };
+
+    default_init_allocator() = default;
+    template <typename U, typename B>
+    default_init_allocator(const default_init_allocator<U, B>& other) noexcept
+        : A(static_cast<const B&>(other)) {}
+
+    template <typename U>
+    void construct(U* p) {
+        ::new (static_cast<void*>(p)) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+} // namespace detail
@@ -0,0 +1,468 @@
+// distributed_atomic_shared_ptr.hpp
+//
+// A shared_ptr whose reference count is spread across cache line padded
+// per-thread shards, and an atomic_shared_ptr for it.
+//
+// With an ordinary shared_ptr every read of a snapshot increments and
+// decrements the same counter, so at high core counts the readers of a hot
+// snapshot serialize on that cache line. Here a thread counts its references
+// on its own shard, and the shards are only summed when the version is no
+// longer published, so readers of a published version do not write any
+// shared cache line. Versions which are never published are counted
+// centrally.
+#pragma once
+
+#include <detail/cache_line.hpp>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace detail { namespace distributed {
+
+// Index of the calling thread, it selects the shard a thread counts on.
+inline std::size_t thread_index() noexcept {
+    static thread_local const std::size_t i =
+        std::hash<std::thread::id>{}(std::this_thread::get_id());
+    return i;
+}
+
+// Hazard slots protect the window of a load between reading the stored
+// pointer and taking a reference on it. A store waits until no slot holds the
+// pointer it has replaced before it drops the reference of the
+// atomic_shared_ptr.
+//
+// Each thread owns a slot while it runs. If there are more threads than
+// slots, the rest register in a shared counter, which a store waits to drain.
+class hazard_slots {
+    static constexpr std::size_t num_slots = 128;
+
+    struct slot {
+        std::atomic<const void*> ptr{nullptr};
+        std::atomic<bool> owned{false};
+    };
+
+    static padded<slot>* slots() noexcept {
+        static padded<slot> s[num_slots];
+        return s;
+    }
+
+    static std::atomic<long>& overflow() noexcept {
+        static std::atomic<long> n{0};
+        return n;
+    }
+
+    // Gives the slot back when the thread exits.
+    struct registration {
+        slot* s = nullptr;
+        registration() noexcept {
+            for (std::size_t i = 0; i < num_slots; ++i) {
+                slot& candidate = slots()[i].value;
+                if (!candidate.owned.load(std::memory_order_relaxed) &&
+                    !candidate.owned.exchange(true,
+                                              std::memory_order_acquire)) {
+                    s = &candidate;
+                    return;
+                }
+            }
+        }
+        ~registration() {
+            if (s) s->owned.store(false, std::memory_order_release);
+        }
+    };
+
+    static slot* own_slot() noexcept {
+        static thread_local registration r;
+        return r.s;
+    }
+
+public:
+    // Protects the pointer read by `protect` until it is destroyed.
+    class guard {
+        slot* s = own_slot();
+
+    public:
+        guard() noexcept {
+            if (!s) overflow().fetch_add(1, std::memory_order_seq_cst);
+        }
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+
+        ~guard() {
+            if (s) {
+                s->ptr.store(nullptr, std::memory_order_release);
+            } else {
+                overflow().fetch_sub(1, std::memory_order_release);
+            }
+        }
+
+        template <typename P>
+        P* protect(const std::atomic<P*>& word) noexcept {
+            if (!s) return word.load(std::memory_order_seq_cst);
+            P* p = word.load(std::memory_order_relaxed);
+            for (;;) {
+                s->ptr.store(p, std::memory_order_seq_cst);
+                P* q = word.load(std::memory_order_seq_cst);
+                if (q == p) return p;
+                p = q;
+            }
+        }
+    };
+
+    // Waits until no load which might have read `p` before it was replaced
+    // is in its window.
+    static void wait_unprotected(const void* p) noexcept {
+        for (std::size_t i = 0; i < num_slots; ++i) {
+            const slot& s = slots()[i].value;
+            while (s.ptr.load(std::memory_order_seq_cst) == p) {
+                std::this_thread::yield();
+            }
+        }
+        while (overflow().load(std::memory_order_seq_cst) != 0) {
+            std::this_thread::yield();
+        }
+    }
+};
+
+// The control block and the value in one allocation.
+//
+// A reference is counted either on the shard of the thread which took it or
+// on the central count. The shards start dead, they are activated when the
+// node is first published and collapsed into the central count (and dead
+// again) when it is no longer published by any atomic_shared_ptr. A node is
+// activated at most once. While the shards are live, the central count
+// carries a bias, so it cannot drop to zero before the collapse.
+//
+// A dead shard holds a large negative value. An increment which finds its
+// shard dead counts centrally instead, a decrement which finds the shard of
+// its reference dead has been moved to the central count by the collapse and
+// decrements that one.
+//
+// The shards are cache line aligned, so nodes are allocated with the
+// allocation functions of cache_aligned.
+template <typename T>
+struct node : cache_aligned {
+    static constexpr std::size_t num_shards = 16;
+    static constexpr long dead = LONG_MIN / 2;
+    static constexpr long bias = LONG_MAX / 4;
+    static constexpr int central_shard = -1;
+
+    enum state_type { fresh, live, collapsed };
+
+    struct control {
+        std::atomic<long> central{1};
+        std::atomic<int> state{fresh};
+        // Guards the transitions, publications counts the atomic_shared_ptrs
+        // which store (or are about to store) the node.
+        std::atomic_flag lock = ATOMIC_FLAG_INIT;
+        int publications = 0;
+    };
+
+    padded<std::atomic<long>> shards[num_shards];
+    padded<control> ctl;
+    T value;
+
+    template <typename... Args>
+    explicit node(Args&&... args) : value(std::forward<Args>(args)...) {
+        for (auto& s : shards) {
+            s.value.store(dead, std::memory_order_relaxed);
+        }
+    }
+
+    // Takes a reference and returns the shard it is counted on.
+    int add_ref() noexcept {
+        // Acquire, so that the activation of the shards happens before our
+        // increment.
+        if (ctl.value.state.load(std::memory_order_acquire) == live) {
+            int i = static_cast<int>(thread_index() % num_shards);
+            if (shards[i].value.fetch_add(1, std::memory_order_relaxed) >=
+                0) {
+                return i;
+            }
+        }
+        ctl.value.central.fetch_add(1, std::memory_order_relaxed);
+        return central_shard;
+    }
+
+    // Returns true if this was the last reference.
+    bool release_ref(int shard) noexcept {
+        if (shard != central_shard &&
+            shards[shard].value.fetch_sub(1, std::memory_order_release) > 0) {
+            return false;
+        }
+        return ctl.value.central.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    void lock() noexcept {
+        while (ctl.value.lock.test_and_set(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+    void unlock() noexcept { ctl.value.lock.clear(std::memory_order_release); }
+
+    // Called by an atomic_shared_ptr before it stores the node.
+    void published() noexcept {
+        lock();
+        if (++ctl.value.publications == 1 &&
+            ctl.value.state.load(std::memory_order_relaxed) == fresh) {
+            ctl.value.central.fetch_add(bias, std::memory_order_relaxed);
+            for (auto& s : shards) {
+                s.value.store(0, std::memory_order_relaxed);
+            }
+            ctl.value.state.store(live, std::memory_order_release);
+        }
+        unlock();
+    }
+
+    // Called by an atomic_shared_ptr after it has replaced the node, while
+    // it still holds its reference.
+    void unpublished() noexcept {
+        lock();
+        if (--ctl.value.publications == 0 &&
+            ctl.value.state.load(std::memory_order_relaxed) == live) {
+            ctl.value.state.store(collapsed, std::memory_order_relaxed);
+            long sum = 0;
+            for (auto& s : shards) {
+                sum += s.value.exchange(dead, std::memory_order_acq_rel);
+            }
+            ctl.value.central.fetch_add(sum - bias,
+                                        std::memory_order_acq_rel);
+        }
+        unlock();
+    }
+};
+
+template <typename T>
+using node_t = node<std::remove_const_t<T>>;
+
+template <typename T>
+class atomic_shared_ptr;
+
+template <typename T>
+class shared_ptr {
+    using node_type = node_t<T>;
+
+    node_type* ptr = nullptr;
+    int shard = node_type::central_shard;
+
+    template <typename>
+    friend class shared_ptr;
+    template <typename>
+    friend class atomic_shared_ptr;
+    template <typename U, typename... Args>
+    friend shared_ptr<U> make_shared(Args&&... args);
+
+    // Takes over a reference which has already been counted.
+    struct adopt_t {};
+    shared_ptr(node_type* n, int shard, adopt_t) noexcept
+        : ptr(n), shard(shard) {}
+
+    // Takes a new reference on n.
+    explicit shared_ptr(node_type* n) noexcept
+        : ptr(n), shard(n ? n->add_ref() : node_type::central_shard) {}
+
+    template <typename Y>
+    using enable_if_convertible =
+        std::enable_if_t<std::is_same<std::remove_const_t<Y>,
+                                      std::remove_const_t<T>>::value &&
+                         (std::is_const<T>::value || !std::is_const<Y>::value)>;
+
+public:
+    using element_type = T;
+
+    constexpr shared_ptr() noexcept = default;
+    constexpr shared_ptr(std::nullptr_t) noexcept {}
+
+    shared_ptr(const shared_ptr& r) noexcept : shared_ptr(r.ptr) {}
+
+    shared_ptr(shared_ptr&& r) noexcept : ptr(r.ptr), shard(r.shard) {
+        r.ptr = nullptr;
+    }
+
+    template <typename Y, typename = enable_if_convertible<Y>>
+    shared_ptr(const shared_ptr<Y>& r) noexcept : shared_ptr(r.ptr) {}
+
+    template <typename Y, typename = enable_if_convertible<Y>>
+    shared_ptr(shared_ptr<Y>&& r) noexcept : ptr(r.ptr), shard(r.shard) {
+        r.ptr = nullptr;
+    }
+
+    ~shared_ptr() {
+        if (ptr && ptr->release_ref(shard)) delete ptr;
+    }
+
+    shared_ptr& operator=(shared_ptr r) noexcept {
+        swap(r);
+        return *this;
+    }
+
+    void swap(shared_ptr& r) noexcept {
+        std::swap(ptr, r.ptr);
+        std::swap(shard, r.shard);
+    }
+
+    void reset() noexcept { shared_ptr().swap(*this); }
+
+    T* get() const noexcept { return ptr ? &ptr->value : nullptr; }
+    T& operator*() const noexcept { return *get(); }
+    T* operator->() const noexcept { return get(); }
+    explicit operator bool() const noexcept { return ptr != nullptr; }
+
+    template <typename Y>
+    bool operator==(const shared_ptr<Y>& r) const noexcept {
+        return get() == r.get();
+    }
+    template <typename Y>
+    bool operator!=(const shared_ptr<Y>& r) const noexcept {
+        return get() != r.get();
+    }
+};
+
+template <typename T, typename... Args>
+shared_ptr<T> make_shared(Args&&... args) {
+    // The central count of a new node starts at one.
+    return {new node_t<T>(std::forward<Args>(args)...),
+            node_t<T>::central_shard, typename shared_ptr<T>::adopt_t{}};
+}
+
+// The atomic_shared_ptr holds one central reference on the stored node.
+//
+// A load protects the stored pointer with a hazard slot and then takes a
+// reference on the shard of the calling thread, so loads are lock-free and
+// write only the cache lines of their thread. Operations which replace a node
+// wait for the loads which are in their window on it; this window is a few
+// instructions long. All operations are sequentially consistent, whatever
+// order is given.
+template <typename T>
+class atomic_shared_ptr {
+    using sp = shared_ptr<T>;
+    using node_type = node_t<T>;
+
+    std::atomic<node_type*> stored{nullptr};
+
+    // Takes the reference of the atomic_shared_ptr on the node of desired
+    // before it is stored. Once it is stored, another thread may replace it
+    // and drop that reference at any time, so it is published while desired
+    // still keeps it alive.
+    static node_type* publish(const sp& desired) noexcept {
+        node_type* n = desired.ptr;
+        if (n) {
+            n->ctl.value.central.fetch_add(1, std::memory_order_relaxed);
+            n->published();
+        }
+        return n;
+    }
+
+    // Turns a replaced node into a shared_ptr.
+    static sp replaced(node_type* n) noexcept {
+        if (!n) return {};
+        hazard_slots::wait_unprotected(n);
+        n->unpublished();
+        return {n, node_type::central_shard, typename sp::adopt_t{}};
+    }
+
+public:
+    constexpr atomic_shared_ptr() noexcept = default;
+    atomic_shared_ptr(const sp& desired) noexcept : stored(publish(desired)) {}
+
+    atomic_shared_ptr(const atomic_shared_ptr&) = delete;
+    void operator=(const atomic_shared_ptr&) = delete;
+
+    ~atomic_shared_ptr() { replaced(stored.load(std::memory_order_acquire)); }
+
+    void operator=(sp desired) noexcept { store(std::move(desired)); }
+
+    bool is_lock_free() const noexcept { return false; }
+
+    void store(sp desired,
+               std::memory_order order = std::memory_order_seq_cst) noexcept {
+        exchange(std::move(desired), order);
+    }
+
+    sp load(std::memory_order = std::memory_order_seq_cst) const noexcept {
+        hazard_slots::guard g;
+        return sp(g.protect(stored));
+    }
+
+    operator sp() const noexcept { return load(); }
+
+    sp exchange(sp desired,
+                std::memory_order = std::memory_order_seq_cst) noexcept {
+        return replaced(
+            stored.exchange(publish(desired), std::memory_order_seq_cst));
+    }
+
+    // Leaves desired intact on failure, though its node is then counted
+    // centrally if it is stored later (copy_update makes a new copy for each
+    // attempt anyway). It does not fail spuriously.
+    bool compare_exchange_strong(sp& expected, sp&& desired,
+                                 std::memory_order,
+                                 std::memory_order) noexcept {
+        node_type* n = publish(desired);
+        node_type* cur = expected.ptr;
+        if (stored.compare_exchange_strong(cur, n,
+                                           std::memory_order_seq_cst)) {
+            desired.reset();
+            replaced(cur);
+            return true;
+        }
+        // Never stored, so no load can have seen it.
+        if (n) {
+            n->unpublished();
+            sp(n, node_type::central_shard, typename sp::adopt_t{});
+        }
+        expected = load();
+        return false;
+    }
+
+    bool compare_exchange_strong(sp& expected, const sp& desired,
+                                 std::memory_order success,
+                                 std::memory_order failure) noexcept {
+        return compare_exchange_strong(expected, sp(desired), success, failure);
+    }
+
+    bool compare_exchange_strong(
+        sp& expected, const sp& desired,
+        std::memory_order order = std::memory_order_seq_cst) noexcept {
+        return compare_exchange_strong(expected, desired, order, order);
+    }
+
+    bool compare_exchange_strong(
+        sp& expected, sp&& desired,
+        std::memory_order order = std::memory_order_seq_cst) noexcept {
+        return compare_exchange_strong(expected, std::move(desired), order,
+                                       order);
+    }
+
+    bool compare_exchange_weak(sp& expected, const sp& desired,
+                               std::memory_order success,
+                               std::memory_order failure) noexcept {
+        return compare_exchange_strong(expected, desired, success, failure);
+    }
+
+    bool compare_exchange_weak(sp& expected, sp&& desired,
+                               std::memory_order success,
+                               std::memory_order failure) noexcept {
+        return compare_exchange_strong(expected, std::move(desired), success,
+                                       failure);
+    }
+
+    bool compare_exchange_weak(
+        sp& expected, const sp& desired,
+        std::memory_order order = std::memory_order_seq_cst) noexcept {
+        return compare_exchange_strong(expected, desired, order, order);
+    }
+
+    bool compare_exchange_weak(
+        sp& expected, sp&& desired,
+        std::memory_order order = std::memory_order_seq_cst) noexcept {
+        return compare_exchange_strong(expected, std::move(desired), order,
+                                       order);
+    }
+};
+
+} // namespace distributed
+} // namespace detail
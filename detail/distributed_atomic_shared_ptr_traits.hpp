@@ -0,0 +1,23 @@
+// distributed_atomic_shared_ptr_traits.hpp
+//
+#pragma once
+#include <detail/distributed_atomic_shared_ptr.hpp>
+
+namespace detail { namespace distributed {
+
+template< template <typename> class AtomicSharedPtr >
+struct atomic_shared_ptr_traits
+{
+  template< typename T >
+  using atomic_shared_ptr = AtomicSharedPtr<T>;
+
+  template< typename T >
+  using shared_ptr = distributed::shared_ptr<T>;
+
+  template< typename T, typename... Args >
+  static auto make_shared(Args &&...args)
+  { return distributed::make_shared<T>(std::forward<Args>(args)...); }
+};
+
+} // namespace distributed
+} // namespace detail
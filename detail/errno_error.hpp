@@ -0,0 +1,16 @@
+// errno_error.hpp
+//
+#pragma once
+
+#include <cerrno>
+#include <string>
+#include <system_error>
+
+namespace detail {
+
+// The error of a failed system call.
+inline std::system_error errno_error(const std::string& what) {
+    return std::system_error(errno, std::generic_category(), what);
+}
+
+} // namespace detail
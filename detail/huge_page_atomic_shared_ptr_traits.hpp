@@ -0,0 +1,42 @@
+// huge_page_atomic_shared_ptr_traits.hpp
+//
+#pragma once
+#include <detail/default_init_allocator.hpp>
+#include <detail/huge_page_allocator.hpp>
+#include <memory>
+#include <utility>
+
+namespace detail { namespace huge_pages {
+
+// Traits for an atomic_shared_ptr of std::shared_ptr (e.g. the default
+// detail::__std backend) which allocate the versions with a
+// huge_page_allocator: a version of at least huge_page_threshold bytes,
+// e.g. a large std::array, is placed in pre-faulted huge pages together
+// with its control block. The members a version allocates itself, like the
+// elements of a vector, need the allocator in their type.
+template <template <typename> class AtomicSharedPtr,
+          huge_page_mode Mode = huge_page_mode::transparent>
+struct atomic_shared_ptr_traits {
+    template <typename T>
+    using atomic_shared_ptr = AtomicSharedPtr<T>;
+
+    template <typename T>
+    using shared_ptr = std::shared_ptr<T>;
+
+    template <typename T, typename... Args>
+    static auto make_shared(Args&&... args) {
+        return std::allocate_shared<T>(huge_page_allocator<T, Mode>(),
+                                       std::forward<Args>(args)...);
+    }
+
+    // Like make_shared<T>(), but a trivially constructible T is left
+    // uninitialized.
+    template <typename T>
+    static auto make_shared_for_overwrite() {
+        return std::allocate_shared<T>(
+            default_init_allocator<T, huge_page_allocator<T, Mode> >());
+    }
+};
+
+} // namespace huge_pages
+} // namespace detail
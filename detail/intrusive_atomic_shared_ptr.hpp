@@ -0,0 +1,373 @@
+// intrusive_atomic_shared_ptr.hpp
+//
+// A shared_ptr whose reference count lives inside the pointee and a lock-free
+// atomic_shared_ptr for it which needs only a single word CAS.
+//
+// Types deriving from intrusive::ref_counter carry their own count. Any other
+// type is wrapped together with a count into one node by make_shared. Either
+// way a version is one allocation and the count shares the cache lines of
+// the data.
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace detail { namespace intrusive {
+
+// Base class of intrusively counted types. Copies start with a zero count, so
+// copy construction (as copy_update does) gives an unshared object.
+class ref_counter {
+public:
+    ref_counter() noexcept = default;
+    ref_counter(const ref_counter&) noexcept {}
+    ref_counter& operator=(const ref_counter&) noexcept { return *this; }
+
+protected:
+    ~ref_counter() = default;
+
+private:
+    mutable std::atomic<std::size_t> ref_count{0};
+
+    friend void add_ref(const ref_counter* c, std::size_t n) noexcept {
+        c->ref_count.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    // Returns true if this was the last reference.
+    friend bool release_ref(const ref_counter* c, std::size_t n) noexcept {
+        return c->ref_count.fetch_sub(n, std::memory_order_acq_rel) == n;
+    }
+};
+
+template <typename T>
+struct ref_counted_node : ref_counter {
+    T value;
+
+    template <typename... Args>
+    explicit ref_counted_node(Args&&... args)
+        : value(std::forward<Args>(args)...) {}
+};
+
+// Maps T to the object which carries the count.
+template <typename T, bool = std::is_base_of<ref_counter, T>::value>
+struct node_traits {
+    using node_type = T;
+    static T* value(node_type* n) noexcept { return n; }
+};
+
+template <typename T>
+struct node_traits<T, false> {
+    using node_type = ref_counted_node<T>;
+    static T* value(node_type* n) noexcept { return &n->value; }
+};
+
+template <typename T>
+using node_traits_t = node_traits<std::remove_const_t<T>>;
+
+template <typename T>
+void release(T* node, std::size_t n) noexcept {
+    if (release_ref(node, n)) delete node;
+}
+
+template <typename T>
+class atomic_shared_ptr;
+
+template <typename T>
+class shared_ptr {
+    using node_type = typename node_traits_t<T>::node_type;
+
+    node_type* node = nullptr;
+
+    template <typename>
+    friend class shared_ptr;
+    template <typename>
+    friend class atomic_shared_ptr;
+    template <typename U, typename... Args>
+    friend shared_ptr<U> make_shared(Args&&... args);
+
+    // Takes over a reference which has already been counted.
+    struct adopt_t {};
+    shared_ptr(node_type* n, adopt_t) noexcept : node(n) {}
+
+    template <typename Y>
+    using enable_if_convertible =
+        std::enable_if_t<std::is_same<std::remove_const_t<Y>,
+                                      std::remove_const_t<T>>::value &&
+                         (std::is_const<T>::value || !std::is_const<Y>::value)>;
+
+public:
+    using element_type = T;
+
+    constexpr shared_ptr() noexcept = default;
+    constexpr shared_ptr(std::nullptr_t) noexcept {}
+
+    shared_ptr(const shared_ptr& r) noexcept : node(r.node) {
+        if (node) add_ref(node, 1);
+    }
+
+    shared_ptr(shared_ptr&& r) noexcept : node(r.node) { r.node = nullptr; }
+
+    template <typename Y, typename = enable_if_convertible<Y>>
+    shared_ptr(const shared_ptr<Y>& r) noexcept : node(r.node) {
+        if (node) add_ref(node, 1);
+    }
+
+    template <typename Y, typename = enable_if_convertible<Y>>
+    shared_ptr(shared_ptr<Y>&& r) noexcept : node(r.node) {
+        r.node = nullptr;
+    }
+
+    ~shared_ptr() {
+        if (node) release(node, 1);
+    }
+
+    shared_ptr& operator=(shared_ptr r) noexcept {
+        swap(r);
+        return *this;
+    }
+
+    void swap(shared_ptr& r) noexcept { std::swap(node, r.node); }
+
+    void reset() noexcept { shared_ptr().swap(*this); }
+
+    T* get() const noexcept {
+        return node ? node_traits_t<T>::value(node) : nullptr;
+    }
+    T& operator*() const noexcept { return *get(); }
+    T* operator->() const noexcept { return get(); }
+    explicit operator bool() const noexcept { return node != nullptr; }
+
+    template <typename Y>
+    bool operator==(const shared_ptr<Y>& r) const noexcept {
+        return get() == r.get();
+    }
+    template <typename Y>
+    bool operator!=(const shared_ptr<Y>& r) const noexcept {
+        return get() != r.get();
+    }
+};
+
+template <typename T, typename... Args>
+shared_ptr<T> make_shared(Args&&... args) {
+    using node_type = typename node_traits_t<T>::node_type;
+    auto* node = new node_type(std::forward<Args>(args)...);
+    add_ref(node, 1);
+    return {node, typename shared_ptr<T>::adopt_t{}};
+}
+
+// Lock-free atomic_shared_ptr with split reference counting in a single word.
+//
+// The word holds the node pointer in its low 48 bits (the user space address
+// range of x86-64 and AArch64) and a local count in its high 16 bits. While
+// a node is stored, the atomic_shared_ptr holds `reserved` references on it.
+// A load takes one of them by incrementing the local count with a single
+// fetch_add, so it does not touch the node at all; the local count is given
+// back to the node in bulk when it reaches half of `reserved`. When the node
+// is replaced, the references which have not been taken are released.
+//
+// At most reserved / 2 loads may be in flight between their fetch_add and the
+// refill at the same time.
+template <typename T>
+class atomic_shared_ptr {
+    using sp = shared_ptr<T>;
+    using node_type = typename node_traits_t<T>::node_type;
+
+    static_assert(sizeof(void*) == 8, "needs 64 bit pointers");
+
+    static constexpr unsigned count_shift = 48;
+    static constexpr std::uint64_t ptr_mask = (std::uint64_t(1) << 48) - 1;
+    static constexpr std::uint64_t count_one = std::uint64_t(1) << count_shift;
+    static constexpr std::size_t reserved = std::size_t(1) << 15;
+
+    mutable std::atomic<std::uint64_t> word{0};
+
+    // Operations which may go on to access the node of the word they read
+    // must synchronize with the store of that word.
+    static std::memory_order with_acquire(std::memory_order order) noexcept {
+        switch (order) {
+            case std::memory_order_relaxed:
+            case std::memory_order_consume:
+                return std::memory_order_acquire;
+            case std::memory_order_release:
+                return std::memory_order_acq_rel;
+            default:
+                return order;
+        }
+    }
+
+    static node_type* ptr(std::uint64_t w) noexcept {
+        return reinterpret_cast<node_type*>(
+            static_cast<std::uintptr_t>(w & ptr_mask));
+    }
+    static std::size_t local(std::uint64_t w) noexcept {
+        return static_cast<std::size_t>(w >> count_shift);
+    }
+
+    // Takes over the reference of desired and reserves the rest.
+    static std::uint64_t acquire(sp&& desired) noexcept {
+        node_type* n = desired.node;
+        desired.node = nullptr;
+        if (!n) return 0;
+        add_ref(n, reserved - 1);
+        auto w = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(n));
+        assert((w & ~ptr_mask) == 0);
+        return w;
+    }
+
+    // Undoes acquire for a word which has not been stored.
+    static void unacquire(std::uint64_t w, sp& desired) noexcept {
+        desired.node = ptr(w);
+        if (desired.node) release(desired.node, reserved - 1);
+    }
+
+    // Releases the references which were not taken by loads.
+    static void release_stored(std::uint64_t w) noexcept {
+        if (node_type* n = ptr(w)) release(n, reserved - local(w));
+    }
+
+    // Turns a word which is no longer stored into a shared_ptr.
+    static sp adopt_stored(std::uint64_t w) noexcept {
+        node_type* n = ptr(w);
+        if (!n) return {};
+        std::size_t owned = reserved - local(w);
+        if (owned > 1) release(n, owned - 1);
+        return {n, typename sp::adopt_t{}};
+    }
+
+    // Gives the taken local count back to the node, seen is the word after
+    // our fetch_add.
+    void refill(std::uint64_t seen) const noexcept {
+        node_type* n = ptr(seen);
+        std::size_t k = local(seen);
+        add_ref(n, k);
+        std::uint64_t expected = seen;
+        while (ptr(expected) == n && local(expected) >= k) {
+            if (word.compare_exchange_weak(expected, expected - k * count_one,
+                                           std::memory_order_relaxed)) {
+                return;
+            }
+        }
+        // Replaced or refilled by someone else meanwhile.
+        release(n, k);
+    }
+
+public:
+    constexpr atomic_shared_ptr() noexcept = default;
+    atomic_shared_ptr(sp desired) noexcept : word(acquire(std::move(desired))) {}
+
+    atomic_shared_ptr(const atomic_shared_ptr&) = delete;
+    void operator=(const atomic_shared_ptr&) = delete;
+
+    ~atomic_shared_ptr() { release_stored(word.load(std::memory_order_acquire)); }
+
+    void operator=(sp desired) noexcept { store(std::move(desired)); }
+
+    bool is_lock_free() const noexcept { return word.is_lock_free(); }
+
+    void store(sp desired,
+               std::memory_order order = std::memory_order_seq_cst) noexcept {
+        release_stored(
+            word.exchange(acquire(std::move(desired)), with_acquire(order)));
+    }
+
+    sp load(std::memory_order order = std::memory_order_seq_cst) const
+        noexcept {
+        std::uint64_t w =
+            word.fetch_add(count_one, with_acquire(order)) + count_one;
+        node_type* n = ptr(w);
+        if (!n) return {};
+        if (local(w) >= reserved / 2) refill(w);
+        return {n, typename sp::adopt_t{}};
+    }
+
+    operator sp() const noexcept { return load(); }
+
+    sp exchange(sp desired,
+                std::memory_order order = std::memory_order_seq_cst) noexcept {
+        return adopt_stored(
+            word.exchange(acquire(std::move(desired)), with_acquire(order)));
+    }
+
+    // Compares the stored pointer only, the local count may differ. It does
+    // not fail spuriously.
+    bool compare_exchange_strong(sp& expected, sp&& desired,
+                                 std::memory_order success,
+                                 std::memory_order failure) noexcept {
+        std::uint64_t cur = word.load(std::memory_order_relaxed);
+        std::uint64_t desired_word = 0;
+        bool acquired = false;
+        for (;;) {
+            if (ptr(cur) != expected.node) {
+                sp current = load(failure);
+                if (current.node != expected.node) {
+                    if (acquired) unacquire(desired_word, desired);
+                    expected = std::move(current);
+                    return false;
+                }
+                cur = word.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (!acquired) {
+                desired_word = acquire(std::move(desired));
+                acquired = true;
+            }
+            if (word.compare_exchange_weak(cur, desired_word,
+                                           with_acquire(success),
+                                           std::memory_order_relaxed)) {
+                release_stored(cur);
+                return true;
+            }
+        }
+    }
+
+    bool compare_exchange_strong(sp& expected, const sp& desired,
+                                 std::memory_order success,
+                                 std::memory_order failure) noexcept {
+        return compare_exchange_strong(expected, sp(desired), success, failure);
+    }
+
+    bool compare_exchange_strong(
+        sp& expected, const sp& desired,
+        std::memory_order order = std::memory_order_seq_cst) noexcept {
+        return compare_exchange_strong(expected, desired, order, order);
+    }
+
+    bool compare_exchange_strong(
+        sp& expected, sp&& desired,
+        std::memory_order order = std::memory_order_seq_cst) noexcept {
+        return compare_exchange_strong(expected, std::move(desired), order,
+                                       order);
+    }
+
+    bool compare_exchange_weak(sp& expected, const sp& desired,
+                               std::memory_order success,
+                               std::memory_order failure) noexcept {
+        return compare_exchange_strong(expected, desired, success, failure);
+    }
+
+    bool compare_exchange_weak(sp& expected, sp&& desired,
+                               std::memory_order success,
+                               std::memory_order failure) noexcept {
+        return compare_exchange_strong(expected, std::move(desired), success,
+                                       failure);
+    }
+
+    bool compare_exchange_weak(
+        sp& expected, const sp& desired,
+        std::memory_order order = std::memory_order_seq_cst) noexcept {
+        return compare_exchange_strong(expected, desired, order, order);
+    }
+
+    bool compare_exchange_weak(
+        sp& expected, sp&& desired,
+        std::memory_order order = std::memory_order_seq_cst) noexcept {
+        return compare_exchange_strong(expected, std::move(desired), order,
+                                       order);
+    }
+};
+
+} // namespace intrusive
+} // namespace detail
@@ -0,0 +1,74 @@
+// merge.hpp
+//
+#pragma once
+
+#include <utility>
+
+namespace detail {
+
+// Merges for rcu_ptr::copy_update_merge of writers which declare the parts of
+// the value which their update touches. Updates of disjoint parts merge
+// without calling the update again; if the concurrent writer has changed a
+// touched part too, the merge fails and copy_update_merge starts over.
+
+// For associative containers (std::map, std::unordered_map and the like)
+// whose update touches the keys in keys only, e.g. a std::vector or a
+// std::set of keys. The changes of the concurrent writer are copied into the
+// update entry by entry, the rest of the update is kept. The mapped values
+// must be equality comparable.
+template <typename Keys>
+auto merge_keys(Keys keys) {
+    return [keys = std::move(keys)](const auto& base, auto& mine,
+                                    const auto& theirs) {
+        auto same = [](const auto& a, const auto& b, const auto& key) {
+            auto x = a.find(key);
+            auto y = b.find(key);
+            if (x == a.end() || y == b.end()) {
+                return (x == a.end()) == (y == b.end());
+            }
+            return bool(x->second == y->second);
+        };
+        for (const auto& k : keys) {
+            if (!same(base, theirs, k)) return false;
+        }
+        // The keys which theirs has changed, none of them is touched.
+        for (const auto& e : theirs) {
+            auto b = base.find(e.first);
+            if (b != base.end() && b->second == e.second) continue;
+            auto m = mine.find(e.first);
+            if (m != mine.end()) {
+                m->second = e.second;
+            } else {
+                mine.insert(e);
+            }
+        }
+        for (const auto& e : base) {
+            if (theirs.find(e.first) == theirs.end()) mine.erase(e.first);
+        }
+        return true;
+    };
+}
+
+// For structs whose update touches the given data members only, e.g.
+//   merge_fields(&Stats::count, &Stats::sum)
+// The update takes the version of the concurrent writer, which is copied,
+// with the touched members of the update. The members must be equality
+// comparable.
+template <typename... Fields>
+auto merge_fields(Fields... fields) {
+    return [=](const auto& base, auto& mine, const auto& theirs) {
+        bool conflict = false;
+        bool unchanged[] = {true, (base.*fields == theirs.*fields)...};
+        for (bool u : unchanged) {
+            conflict = conflict || !u;
+        }
+        if (conflict) return false;
+        auto merged = theirs;
+        int swapped[] = {0, (std::swap(merged.*fields, mine.*fields), 0)...};
+        (void)swapped;
+        mine = std::move(merged);
+        return true;
+    };
+}
+
+} // namespace detail
@@ -0,0 +1,166 @@
+// parallel_copy.hpp
+//
+#pragma once
+
+#include <detail/deep_copy.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace detail {
+
+// An executor runs the chunks of a parallel copy. It provides
+//   std::size_t concurrency() const;
+//   template <typename F> void parallel_for(std::size_t n, F&& f);
+// where parallel_for calls f(i) for each i in [0, n), possibly in parallel,
+// and returns when all calls have returned, rethrowing an exception of one.
+
+// Runs the chunks on std::threads which are started for each copy, which
+// costs little compared to copying many megabytes.
+class thread_executor {
+    unsigned threads;
+
+public:
+    explicit thread_executor(
+        unsigned threads = std::thread::hardware_concurrency())
+        : threads(std::max(threads, 1u)) {}
+
+    std::size_t concurrency() const { return threads; }
+
+    template <typename F>
+    void parallel_for(std::size_t n, F&& f) const {
+        std::atomic<std::size_t> next{0};
+        std::exception_ptr error;
+        std::mutex error_mtx;
+        auto work = [&]() {
+            try {
+                for (std::size_t i; (i = next++) < n;) {
+                    f(i);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mtx);
+                if (!error) error = std::current_exception();
+            }
+        };
+        std::vector<std::thread> workers;
+        try {
+            for (std::size_t t = 1; t < threads && t < n; ++t) {
+                workers.emplace_back(work);
+            }
+        } catch (...) {
+            // A thread could not be started (std::system_error) or stored,
+            // the threads which run and this one do all chunks.
+        }
+        work();
+        for (auto& w : workers) {
+            w.join();
+        }
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+// Smaller copies are not worth splitting.
+constexpr std::size_t parallel_copy_threshold = 8 << 20;
+constexpr std::size_t parallel_copy_min_chunk = 1 << 20;
+
+// Calls copy(begin, end) for chunks of [0, n) on the executor. The chunks
+// hold at least parallel_copy_min_chunk bytes if elements are size bytes.
+template <typename Executor, typename Copy>
+void for_each_chunk(std::size_t n, std::size_t size, Executor& executor,
+                    Copy&& copy) {
+    std::size_t chunks = std::min<std::size_t>(
+        executor.concurrency() * 4,
+        std::max<std::size_t>(n * size / parallel_copy_min_chunk, 1));
+    chunks = std::min(chunks, n);
+    std::size_t per_chunk = (n + chunks - 1) / chunks;
+    executor.parallel_for(chunks, [&](std::size_t c) {
+        std::size_t begin = c * per_chunk;
+        std::size_t end = std::min(n, begin + per_chunk);
+        if (begin < end) copy(begin, end);
+    });
+}
+
+template <typename T>
+void copy_range(T* dst, const T* src, std::size_t n, std::true_type) {
+    stream_copy(dst, src, n * sizeof(T));
+}
+
+template <typename T>
+void copy_range(T* dst, const T* src, std::size_t n, std::false_type) {
+    std::copy(src, src + n, dst);
+}
+
+template <typename ASPTraits, typename T, typename Executor>
+auto parallel_copy(const T& value, Executor&, std::false_type) {
+    return deep_copy<ASPTraits>(value);
+}
+
+template <typename ASPTraits, typename T, typename Executor>
+auto parallel_copy(const T& value, Executor& executor, std::true_type) {
+    if (sizeof(T) < parallel_copy_threshold) {
+        return deep_copy<ASPTraits>(value);
+    }
+    auto copy = make_shared_for_overwrite<T, ASPTraits>(0);
+    auto dst = reinterpret_cast<char*>(copy.get());
+    auto src = reinterpret_cast<const char*>(std::addressof(value));
+    for_each_chunk(sizeof(T), 1, executor,
+                   [&](std::size_t begin, std::size_t end) {
+                       stream_copy(dst + begin, src + begin, end - begin);
+                   });
+    return copy;
+}
+
+// Returns a copy of value made by ASPTraits like deep_copy, but splits the
+// copy of large values across the threads of the executor:
+//  - trivially copyable, default constructible values of at least
+//    parallel_copy_threshold bytes, which are streamed in chunks,
+//  - vectors of at least parallel_copy_threshold bytes (counting
+//    sizeof(T) per element), whose elements are default constructed first
+//    and then copied in chunks, trivially copyable ones with stream_copy.
+//    Vectors of trivially copyable elements are split only if they use a
+//    default_init_allocator, which leaves the elements uninitialized instead
+//    of zeroing them. Copying the elements must be safe to run
+//    concurrently. Elements must be default constructible,
+//    std::vector<bool> is not split.
+// Other values, and values with an rcu_clone customization, are copied by
+// deep_copy.
+template <typename ASPTraits, typename T, typename Executor>
+auto parallel_copy(const T& value, Executor& executor) {
+    return parallel_copy<ASPTraits>(
+        value, executor,
+        std::integral_constant<bool,
+                               std::is_trivially_copyable<T>::value &&
+                                   std::is_default_constructible<T>::value &&
+                                   !has_rcu_clone<T>::value>());
+}
+
+template <typename ASPTraits, typename T, typename A, typename Executor,
+          typename = std::enable_if_t<
+              std::is_default_constructible<T>::value &&
+              !std::is_same<T, bool>::value &&
+              !has_rcu_clone<std::vector<T, A> >::value> >
+auto parallel_copy(const std::vector<T, A>& value, Executor& executor) {
+    using V = std::vector<T, A>;
+    // resize would zero trivially copyable elements before they are copied,
+    // unless the vector leaves them uninitialized.
+    bool split = (!std::is_trivially_copyable<T>::value ||
+                  is_stream_copyable<V>::value) &&
+                 value.size() * sizeof(T) >= parallel_copy_threshold;
+    if (!split) return deep_copy<ASPTraits>(value);
+    auto copy = ASPTraits::template make_shared<V>();
+    copy->resize(value.size());
+    for_each_chunk(value.size(), sizeof(T), executor,
+                   [&](std::size_t begin, std::size_t end) {
+                       copy_range(copy->data() + begin, value.data() + begin,
+                                  end - begin,
+                                  std::is_trivially_copyable<T>());
+                   });
+    return copy;
+}
+
+} // namespace detail
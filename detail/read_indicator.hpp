@@ -0,0 +1,51 @@
+// read_indicator.hpp
+//
+#pragma once
+
+#include <detail/cache_line.hpp>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+namespace detail {
+
+// Counts the readers which are inside a read-side critical section.
+// The count is spread across cache line padded counters, each thread arrives
+// at the one selected by its id, so arriving and departing readers of
+// different threads do not write the same cache line. Arrive and depart are
+// wait-free.
+class read_indicator {
+public:
+    static constexpr std::size_t num_counters = 16;
+
+    // Returns the counter the reader has arrived at, which it passes to
+    // depart, even if it departs on another thread.
+    std::size_t arrive() noexcept {
+        std::size_t slot = index();
+        counters[slot].value.fetch_add(1, std::memory_order_seq_cst);
+        return slot;
+    }
+
+    void depart(std::size_t slot) noexcept {
+        counters[slot].value.fetch_sub(1, std::memory_order_release);
+    }
+
+    bool is_empty() const noexcept {
+        for (const auto& c : counters) {
+            if (c.value.load(std::memory_order_seq_cst) != 0) return false;
+        }
+        return true;
+    }
+
+private:
+    static std::size_t index() noexcept {
+        static thread_local const std::size_t i =
+            std::hash<std::thread::id>{}(std::this_thread::get_id()) %
+            num_counters;
+        return i;
+    }
+
+    padded<std::atomic<long>> counters[num_counters];
+};
+
+} // namespace detail
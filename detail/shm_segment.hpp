@@ -0,0 +1,384 @@
+// shm_segment.hpp
+//
+#pragma once
+
+#include <detail/cache_line.hpp>
+#include <detail/errno_error.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace detail {
+namespace shm {
+
+// A pointer which stores the distance of its target from itself, so that it
+// points to the same object in every process which maps the segment, at
+// whatever address. Copying it recomputes the distance. It can not point to
+// itself, that is the null pointer.
+template <typename U>
+class offset_ptr {
+    std::ptrdiff_t off = 0;
+
+    void set(const U* p) {
+        off = p ? reinterpret_cast<const char*>(p) -
+                      reinterpret_cast<const char*>(this)
+                : 0;
+    }
+
+public:
+    offset_ptr() = default;
+    offset_ptr(std::nullptr_t) {}
+    offset_ptr(U* p) { set(p); }
+    offset_ptr(const offset_ptr& other) { set(other.get()); }
+
+    offset_ptr& operator=(const offset_ptr& other) {
+        set(other.get());
+        return *this;
+    }
+
+    U* get() const {
+        if (off == 0) return nullptr;
+        return reinterpret_cast<U*>(
+            const_cast<char*>(reinterpret_cast<const char*>(this)) + off);
+    }
+
+    U& operator*() const { return *get(); }
+    U* operator->() const { return get(); }
+    U& operator[](std::size_t i) const { return get()[i]; }
+    explicit operator bool() const { return off != 0; }
+};
+
+// A reader process which reads the segment. The writer clears the slots of
+// processes which have exited without releasing them.
+struct reader_slot {
+    std::atomic<std::int32_t> pid; // 0 if the slot is free
+    // The offset of the version which the reader may be reading, 0 if none.
+    std::atomic<std::uint64_t> pinned;
+};
+
+struct header {
+    static const char* magic_value() { return "RCUSHM01"; }
+    char magic[8];
+    std::uint64_t type_size;
+    std::uint64_t max_readers;
+    std::uint64_t page_size;
+    std::uint64_t page_count;
+    std::uint64_t first_page; // the offset of the pages
+    std::uint64_t next_fit;   // where the writer looks for free pages
+    // The offset of the current version, 0 if there is none.
+    std::atomic<std::uint64_t> current;
+    // Followed by the reader slots, and a byte per page which is 1 if the
+    // page is used.
+};
+
+constexpr std::size_t slots_offset =
+    (sizeof(header) + cache_line_size - 1) / cache_line_size * cache_line_size;
+
+struct create_t {};
+
+// A mapping of a named POSIX shared memory segment (Linux only). The segment
+// holds a header, the reader slots and pages which the writer allocates
+// versions from. Offsets are relative to the start of the segment.
+class segment {
+public:
+    // Creates the segment, fails if it exists.
+    // Throws std::system_error, or std::invalid_argument if size is too
+    // small.
+    segment(create_t, const std::string& name, std::size_t size,
+            std::size_t max_readers, std::size_t type_size)
+        : name(name) {
+        fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                        0600);
+        if (fd < 0) throw errno_error("shm_open " + name);
+        try {
+            if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+                throw errno_error("ftruncate " + name);
+            }
+            map(fd, size);
+            init(max_readers, type_size);
+        } catch (...) {
+            if (base) ::munmap(base, length);
+            ::close(fd);
+            ::shm_unlink(name.c_str());
+            throw;
+        }
+    }
+
+    // Opens the segment which a writer has created.
+    // Throws std::system_error, or std::runtime_error if it is not a
+    // segment of type_size values.
+    segment(const std::string& name, std::size_t type_size) : name(name) {
+        int f = ::shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+        if (f < 0) throw errno_error("shm_open " + name);
+        struct stat st;
+        if (::fstat(f, &st) != 0) {
+            auto error = errno_error("fstat " + name);
+            ::close(f);
+            throw error;
+        }
+        try {
+            map(f, static_cast<std::size_t>(st.st_size));
+        } catch (...) {
+            ::close(f);
+            throw;
+        }
+        ::close(f);
+        const char* error = nullptr;
+        if (length < slots_offset ||
+            std::memcmp(head().magic, header::magic_value(),
+                        sizeof(head().magic)) != 0) {
+            error = ": not an initialized segment";
+        } else if (head().type_size != type_size) {
+            error = ": value size mismatch";
+        }
+        if (error) {
+            ::munmap(base, length);
+            throw std::runtime_error(name + error);
+        }
+    }
+
+    segment(const segment&) = delete;
+    segment& operator=(const segment&) = delete;
+
+    ~segment() {
+        ::munmap(base, length);
+        if (fd >= 0) ::close(fd);
+    }
+
+    // Removes the name, the memory is freed when the last process unmaps
+    // it.
+    static void remove(const std::string& name) {
+        ::shm_unlink(name.c_str());
+    }
+
+    header& head() const { return *reinterpret_cast<header*>(base); }
+
+    std::size_t max_readers() const {
+        return static_cast<std::size_t>(head().max_readers);
+    }
+
+    reader_slot& slot(std::size_t i) const {
+        return reinterpret_cast<padded<reader_slot>*>(base + slots_offset)[i]
+            .value;
+    }
+
+    template <typename U>
+    U* at(std::uint64_t offset) const {
+        return reinterpret_cast<U*>(base + offset);
+    }
+
+    std::uint64_t offset_of(const void* p) const {
+        return static_cast<std::uint64_t>(static_cast<const char*>(p) - base);
+    }
+
+    std::size_t page_size() const {
+        return static_cast<std::size_t>(head().page_size);
+    }
+
+    // The page allocator is used by the writer only.
+
+    // Returns the offset of n consecutive free pages.
+    // Throws std::bad_alloc if there are none.
+    std::uint64_t allocate_pages(std::size_t n) {
+        header& h = head();
+        std::size_t pages = static_cast<std::size_t>(h.page_count);
+        std::uint8_t* used = page_map();
+        auto find = [&](std::size_t from) {
+            std::size_t run = 0;
+            for (std::size_t i = from; i < pages; ++i) {
+                run = used[i] ? 0 : run + 1;
+                if (run == n) return i + 1 - n;
+            }
+            return pages;
+        };
+        std::size_t first = n == 0 || n > pages ? pages : find(h.next_fit);
+        if (first == pages && n > 0 && n <= pages) first = find(0);
+        if (first == pages) throw std::bad_alloc();
+        std::memset(used + first, 1, n);
+        h.next_fit = (first + n) % pages;
+        return h.first_page + first * h.page_size;
+    }
+
+    // Frees the n pages at offset and gives their memory back.
+    void free_pages(std::uint64_t offset, std::size_t n) {
+        header& h = head();
+        std::memset(page_map() + (offset - h.first_page) / h.page_size, 0,
+                    n);
+        ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    static_cast<off_t>(offset),
+                    static_cast<off_t>(n * h.page_size));
+    }
+
+    // The number of pages which are allocated.
+    std::size_t used_pages() const {
+        std::uint8_t* used = page_map();
+        return static_cast<std::size_t>(
+            std::count(used, used + head().page_count, 1));
+    }
+
+private:
+    void map(int f, std::size_t size) {
+        void* p =
+            ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, f, 0);
+        if (p == MAP_FAILED) throw errno_error("mmap " + name);
+        base = static_cast<char*>(p);
+        length = size;
+    }
+
+    std::uint8_t* page_map() const {
+        return reinterpret_cast<std::uint8_t*>(
+            base + slots_offset + max_readers() * sizeof(padded<reader_slot>));
+    }
+
+    void init(std::size_t max_readers, std::size_t type_size) {
+        header* h = new (base) header;
+        h->type_size = type_size;
+        h->max_readers = max_readers;
+        h->page_size = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+        h->next_fit = 0;
+        h->current.store(0, std::memory_order_relaxed);
+        for (std::size_t i = 0; i < max_readers; ++i) {
+            new (&reinterpret_cast<padded<reader_slot>*>(base +
+                                                         slots_offset)[i])
+                padded<reader_slot>();
+        }
+        std::size_t map_offset =
+            slots_offset + max_readers * sizeof(padded<reader_slot>);
+        std::size_t page = static_cast<std::size_t>(h->page_size);
+        auto first_page = [&](std::size_t pages) {
+            return (map_offset + pages + page - 1) / page * page;
+        };
+        std::size_t pages =
+            length > map_offset ? (length - map_offset) / (page + 1) : 0;
+        while (pages > 0 && first_page(pages) + pages * page > length) {
+            --pages;
+        }
+        if (pages == 0) {
+            throw std::invalid_argument(name + ": segment too small");
+        }
+        h->page_count = pages;
+        h->first_page = first_page(pages);
+        std::memset(page_map(), 0, pages);
+        // Readers check the magic, it is written last.
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(h->magic, header::magic_value(), sizeof(h->magic));
+    }
+
+    std::string name;
+    int fd = -1; // the writer keeps it to give freed pages back
+    char* base = nullptr;
+    std::size_t length = 0;
+};
+
+// Whether the process with pid exists.
+inline bool process_alive(std::int32_t pid) {
+    return ::kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+}
+
+// A chunk of pages of a version. A version is a list of chunks, the first
+// one holds the value.
+struct chunk {
+    std::uint64_t next;  // the offset of the next chunk, 0 if it is the last
+    std::uint64_t pages;
+    std::uint64_t used;  // bytes, including this header
+    std::uint64_t value; // the offset of the value, in the first chunk
+};
+
+// Allocates the memory of a new version from the pages of the segment.
+// Its memory is freed at once with free_version, no destructors are run.
+class arena {
+    static constexpr std::size_t chunk_pages = 16;
+
+    segment* seg;
+    std::uint64_t first;
+    std::uint64_t last;
+
+    std::uint64_t new_chunk(std::size_t bytes) {
+        std::size_t page = seg->page_size();
+        std::size_t pages = (bytes + sizeof(chunk) + page - 1) / page;
+        if (pages < chunk_pages) pages = chunk_pages;
+        std::uint64_t c = seg->allocate_pages(pages);
+        *seg->at<chunk>(c) = chunk{0, pages, sizeof(chunk), 0};
+        return c;
+    }
+
+public:
+    explicit arena(segment& s) : seg(&s), first(new_chunk(0)), last(first) {}
+
+    // The offset of the version.
+    std::uint64_t version() const { return first; }
+
+    void* allocate(std::size_t bytes, std::size_t align) {
+        for (int attempt = 0;; ++attempt) {
+            chunk& c = *seg->at<chunk>(last);
+            std::uint64_t start = (last + c.used + align - 1) / align * align;
+            if (start + bytes <= last + c.pages * seg->page_size()) {
+                c.used = start + bytes - last;
+                return seg->at<char>(start);
+            }
+            if (attempt > 0) throw std::bad_alloc();
+            std::uint64_t n = new_chunk(bytes + align);
+            c.next = n;
+            last = n;
+        }
+    }
+
+    void set_value(const void* value) {
+        seg->at<chunk>(first)->value = seg->offset_of(value);
+    }
+};
+
+inline void free_version(segment& seg, std::uint64_t version) {
+    while (version != 0) {
+        chunk c = *seg.at<chunk>(version);
+        seg.free_pages(version, static_cast<std::size_t>(c.pages));
+        version = c.next;
+    }
+}
+
+// The allocator of the values of a version. It allocates from the arena of
+// the version, deallocate does nothing. It is process local, values must
+// not store it in the segment.
+template <typename U>
+class allocator {
+    template <typename>
+    friend class allocator;
+
+    arena* a;
+
+public:
+    using value_type = U;
+
+    explicit allocator(arena* a) : a(a) {}
+    template <typename V>
+    allocator(const allocator<V>& other) : a(other.a) {}
+
+    U* allocate(std::size_t n) {
+        return static_cast<U*>(a->allocate(n * sizeof(U), alignof(U)));
+    }
+    void deallocate(U*, std::size_t) {}
+
+    template <typename V>
+    bool operator==(const allocator<V>& other) const {
+        return a == other.a;
+    }
+    template <typename V>
+    bool operator!=(const allocator<V>& other) const {
+        return a != other.a;
+    }
+};
+
+} // namespace shm
+} // namespace detail
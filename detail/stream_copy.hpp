@@ -0,0 +1,120 @@
+// stream_copy.hpp
+//
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define RCU_PTR_STREAM_COPY_X86 1
+#endif
+
+namespace detail {
+
+// Copies larger than this are written with non-temporal stores, which do not
+// allocate the destination in the cache. It is about the size of a L2 cache:
+// smaller copies are likely to be read soon and cost little cache anyway.
+constexpr std::size_t stream_copy_threshold = 1 << 20;
+
+#ifdef RCU_PTR_STREAM_COPY_X86
+
+namespace stream {
+
+// Each variant copies the unaligned head with memcpy, streams the aligned
+// middle and copies the tail with memcpy.
+
+__attribute__((target("avx512f"))) inline void copy_avx512(
+    char* dst, const char* src, std::size_t n) {
+    std::size_t head = std::min<std::size_t>(
+        n, (64 - reinterpret_cast<std::uintptr_t>(dst) % 64) % 64);
+    std::memcpy(dst, src, head);
+    std::size_t i = head;
+    for (; i + 256 <= n; i += 256) {
+        __m512i a = _mm512_loadu_si512(src + i);
+        __m512i b = _mm512_loadu_si512(src + i + 64);
+        __m512i c = _mm512_loadu_si512(src + i + 128);
+        __m512i d = _mm512_loadu_si512(src + i + 192);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + i), a);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + i + 64), b);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + i + 128), c);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + i + 192), d);
+    }
+    std::memcpy(dst + i, src + i, n - i);
+    _mm_sfence();
+}
+
+__attribute__((target("avx2"))) inline void copy_avx2(char* dst,
+                                                      const char* src,
+                                                      std::size_t n) {
+    std::size_t head = std::min<std::size_t>(
+        n, (32 - reinterpret_cast<std::uintptr_t>(dst) % 32) % 32);
+    std::memcpy(dst, src, head);
+    std::size_t i = head;
+    for (; i + 128 <= n; i += 128) {
+        auto s = reinterpret_cast<const __m256i*>(src + i);
+        auto d = reinterpret_cast<__m256i*>(dst + i);
+        __m256i a = _mm256_loadu_si256(s);
+        __m256i b = _mm256_loadu_si256(s + 1);
+        __m256i c = _mm256_loadu_si256(s + 2);
+        __m256i e = _mm256_loadu_si256(s + 3);
+        _mm256_stream_si256(d, a);
+        _mm256_stream_si256(d + 1, b);
+        _mm256_stream_si256(d + 2, c);
+        _mm256_stream_si256(d + 3, e);
+    }
+    std::memcpy(dst + i, src + i, n - i);
+    _mm_sfence();
+}
+
+// SSE2 is part of x86-64.
+inline void copy_sse2(char* dst, const char* src, std::size_t n) {
+    std::size_t head = std::min<std::size_t>(
+        n, (16 - reinterpret_cast<std::uintptr_t>(dst) % 16) % 16);
+    std::memcpy(dst, src, head);
+    std::size_t i = head;
+    for (; i + 64 <= n; i += 64) {
+        auto s = reinterpret_cast<const __m128i*>(src + i);
+        auto d = reinterpret_cast<__m128i*>(dst + i);
+        __m128i a = _mm_loadu_si128(s);
+        __m128i b = _mm_loadu_si128(s + 1);
+        __m128i c = _mm_loadu_si128(s + 2);
+        __m128i e = _mm_loadu_si128(s + 3);
+        _mm_stream_si128(d, a);
+        _mm_stream_si128(d + 1, b);
+        _mm_stream_si128(d + 2, c);
+        _mm_stream_si128(d + 3, e);
+    }
+    std::memcpy(dst + i, src + i, n - i);
+    _mm_sfence();
+}
+
+using copy_fn = void (*)(char*, const char*, std::size_t);
+
+inline copy_fn select() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return copy_avx512;
+    if (__builtin_cpu_supports("avx2")) return copy_avx2;
+    return copy_sse2;
+}
+
+} // namespace stream
+
+// Copies n bytes with non-temporal stores, with the widest vectors the CPU
+// supports. The ranges must not overlap.
+inline void stream_copy(void* dst, const void* src, std::size_t n) {
+    static const stream::copy_fn fn = stream::select();
+    fn(static_cast<char*>(dst), static_cast<const char*>(src), n);
+}
+
+#else
+
+inline void stream_copy(void* dst, const void* src, std::size_t n) {
+    std::memcpy(dst, src, n);
+}
+
+#endif
+
+} // namespace detail
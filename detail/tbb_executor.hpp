@@ -0,0 +1,28 @@
+// tbb_executor.hpp
+//
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+namespace detail {
+
+// Runs the chunks of a parallel copy (see parallel_copy.hpp) on the TBB
+// worker threads, which are not started for every copy.
+class tbb_executor {
+public:
+    std::size_t concurrency() const {
+        return static_cast<std::size_t>(
+            tbb::this_task_arena::max_concurrency());
+    }
+
+    template <typename F>
+    void parallel_for(std::size_t n, F&& f) const {
+        tbb::parallel_for(std::size_t(0), n, std::forward<F>(f));
+    }
+};
+
+} // namespace detail
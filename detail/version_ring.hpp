@@ -0,0 +1,76 @@
+// version_ring.hpp
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace detail {
+
+// A bounded ring of records indexed by version: the record of version v lives
+// in slot v % capacity until a record of a later version replaces it.
+//
+// Record must have a `std::uint64_t version` member. Every version is
+// published by a single writer, so writers only meet on a slot when one of
+// them is lapped; the later version always wins. Publishing and loading are
+// lock-free if the underlying atomic_shared_ptr is.
+template <typename Record, typename ASPTraits>
+class version_ring {
+    template <typename T>
+    using atomic_shared_ptr = typename ASPTraits::template atomic_shared_ptr<T>;
+
+public:
+    template <typename T>
+    using shared_ptr = typename ASPTraits::template shared_ptr<T>;
+
+    explicit version_ring(std::size_t capacity)
+        : cap(capacity > 0 ? capacity : 1),
+          slots(new atomic_shared_ptr<Record>[cap]) {}
+
+    version_ring(const version_ring&) = delete;
+    version_ring& operator=(const version_ring&) = delete;
+
+    std::size_t capacity() const { return cap; }
+
+    void publish(shared_ptr<Record> r) {
+        auto& slot = slot_of(r->version);
+        shared_ptr<Record> cur = slot.load(std::memory_order_acquire);
+        do {
+            // A writer which lapped us got there first.
+            if (cur && cur->version >= r->version) return;
+        } while (!slot.compare_exchange_strong(cur, r,
+                                               std::memory_order_release,
+                                               std::memory_order_acquire));
+    }
+
+    // Empties the slot of version, if it still holds version.
+    void evict(std::uint64_t version) {
+        auto& slot = slot_of(version);
+        shared_ptr<Record> cur = slot.load(std::memory_order_acquire);
+        const shared_ptr<Record> empty;
+        while (cur && cur->version == version &&
+               !slot.compare_exchange_strong(cur, empty,
+                                             std::memory_order_release,
+                                             std::memory_order_acquire)) {
+        }
+    }
+
+    // Returns the record in the slot of version. It is an older version if
+    // version is not published yet, a newer one if it has been overwritten,
+    // or null if the slot was never used.
+    shared_ptr<const Record> load(std::uint64_t version) const {
+        return slot_of(version).load(std::memory_order_acquire);
+    }
+
+private:
+    atomic_shared_ptr<Record>& slot_of(std::uint64_t version) const {
+        return slots[version % cap];
+    }
+
+    const std::size_t cap;
+    const std::unique_ptr<atomic_shared_ptr<Record>[]> slots;
+};
+
+} // namespace detail
@@ -0,0 +1,122 @@
+// write_policy.hpp
+//
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <utility>
+
+namespace detail {
+
+// The write policy of an rcu_ptr decides how copy_update and reset find the
+// current version and publish a new one. It provides
+//   template <typename SharedPtr> class writer;
+// whose members are called by the writers only, see multi_writer.
+
+// Any number of threads may write concurrently: copy_update loads the
+// current version and publishes with a CAS, which fails and is retried if
+// another writer has published meanwhile.
+struct multi_writer {
+    template <typename SharedPtr>
+    class writer {
+    public:
+        explicit writer(const SharedPtr&) {}
+
+        // Held during a write. The destructor is not trivial, so that a
+        // guard is not an unused variable.
+        struct guard {
+            ~guard() {}
+        };
+        guard enter() { return guard(); }
+
+        // The version to copy from.
+        template <typename ASP>
+        SharedPtr load(const ASP& asp) const {
+            return asp.load(std::memory_order_consume);
+        }
+
+        // Publishes desired if expected is still the current version,
+        // otherwise loads the current version into expected.
+        template <typename ASP>
+        bool publish(ASP& asp, SharedPtr& expected, SharedPtr&& desired) {
+            return asp.compare_exchange_strong(expected, std::move(desired),
+                                               std::memory_order_release,
+                                               std::memory_order_consume);
+        }
+
+        template <typename ASP>
+        void store(ASP& asp, SharedPtr desired) {
+            asp.store(std::move(desired), std::memory_order_release);
+        }
+    };
+};
+
+// One thread writes at a time, e.g. a dedicated writer thread. The writer
+// keeps its own reference to the current version, so copy_update copies
+// from it without loading the atomic shared_ptr and publishes with a store
+// instead of a CAS, and never retries. Concurrent writes are a bug, which is
+// detected by an assertion unless NDEBUG is defined.
+//
+// For the same reason a write must not be nested in another one: a reset()
+// or copy_update() from inside the lambda of copy_update is overwritten by
+// the copy when the lambda returns, where multi_writer would retry. The
+// assertion catches this too.
+struct single_writer {
+    template <typename SharedPtr>
+    class writer {
+        SharedPtr current;
+        // Also without the check, so that the layout does not depend on
+        // NDEBUG.
+        std::atomic<bool> writing{false};
+
+    public:
+        explicit writer(const SharedPtr& initial) : current(initial) {}
+
+        // Held during a write. It checks for an overlapping write unless
+        // NDEBUG is defined.
+        class guard {
+            std::atomic<bool>* writing = nullptr;
+
+        public:
+            explicit guard(std::atomic<bool>& w) {
+#ifndef NDEBUG
+                writing = &w;
+                bool writing_already = writing->exchange(true);
+                assert(!writing_already &&
+                       "a write to a single_writer rcu_ptr during another "
+                       "write, from another thread or from the lambda of "
+                       "copy_update");
+                (void)writing_already;
+#else
+                (void)w;
+#endif
+            }
+            guard(guard&& other) : writing(other.writing) {
+                other.writing = nullptr;
+            }
+            ~guard() {
+                if (writing) writing->store(false);
+            }
+        };
+        guard enter() { return guard(writing); }
+
+        template <typename ASP>
+        const SharedPtr& load(const ASP&) const {
+            return current;
+        }
+
+        template <typename ASP>
+        bool publish(ASP& asp, const SharedPtr&, SharedPtr&& desired) {
+            store(asp, std::move(desired));
+            return true;
+        }
+
+        template <typename ASP>
+        void store(ASP& asp, SharedPtr desired) {
+            current = std::move(desired);
+            asp.store(current, std::memory_order_release);
+        }
+    };
+};
+
+} // namespace detail
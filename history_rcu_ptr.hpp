@@ -0,0 +1,189 @@
+#pragma once
+
+#include <rcu_ptr.hpp>
+#include <detail/version_ring.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// An rcu_ptr which keeps its recent versions for time-travel reads.
+//
+// Every version has a number and the time it was published. The last
+// `capacity` versions are kept in a lock-free ring, so read_at can return
+// the version with a given number, or the one which was current at a given
+// time, as long as it is in the ring. If max_age is not zero, versions
+// which have been replaced more than max_age ago are evicted by the writers
+// as well. Memory is bounded by capacity versions either way.
+template <typename T,
+          template <typename> class AtomicSharedPtr =
+              detail::__std::atomic_shared_ptr,
+          typename ASPTraits =
+              detail::atomic_shared_ptr_traits<AtomicSharedPtr> >
+class history_rcu_ptr {
+public:
+    template <typename _T>
+    using shared_ptr = typename ASPTraits::template shared_ptr<_T>;
+    using clock = std::chrono::system_clock;
+
+private:
+    struct state {
+        std::uint64_t version = 0;
+        clock::time_point time;
+        shared_ptr<const T> value;
+    };
+
+    rcu_ptr<state, AtomicSharedPtr, ASPTraits> current;
+    detail::version_ring<state, ASPTraits> log;
+    const clock::duration max_age;
+    // The versions below it are evicted.
+    std::atomic<std::uint64_t> evicted{0};
+
+    void publish(const state& s) {
+        log.publish(ASPTraits::template make_shared<state>(s));
+        evict_expired(s.version, s.time);
+    }
+
+    // Evicts the versions which were replaced more than max_age before now.
+    void evict_expired(std::uint64_t published, clock::time_point now) {
+        if (max_age == clock::duration::zero()) return;
+        std::uint64_t e = evicted.load(std::memory_order_acquire);
+        while (e < published) {
+            if (published - e >= log.capacity()) {
+                // The ring has dropped them already.
+                std::uint64_t oldest = published - log.capacity() + 1;
+                if (evicted.compare_exchange_weak(e, oldest)) e = oldest;
+                continue;
+            }
+            // Version e was replaced when e + 1 was published.
+            auto next = log.load(e + 1);
+            if (!next || next->version < e + 1) return; // not published yet
+            if (next->version == e + 1 && now - next->time < max_age) return;
+            if (evicted.compare_exchange_strong(e, e + 1)) {
+                log.evict(e);
+                ++e;
+            }
+        }
+    }
+
+    bool in_history(const shared_ptr<const state>& r,
+                    std::uint64_t version) const {
+        return r && r->version == version &&
+               version >= evicted.load(std::memory_order_acquire);
+    }
+
+public:
+    // A version, the time it was published and its value.
+    class snapshot {
+        shared_ptr<const state> s;
+
+        friend class history_rcu_ptr;
+        explicit snapshot(shared_ptr<const state> s) : s(std::move(s)) {}
+
+    public:
+        // Empty, only valid after it is assigned.
+        snapshot() = default;
+
+        std::uint64_t version() const { return s->version; }
+        clock::time_point time() const { return s->time; }
+        const shared_ptr<const T>& get() const { return s->value; }
+        const T& operator*() const { return *s->value; }
+        const T* operator->() const { return s->value.get(); }
+        explicit operator bool() const { return bool(s->value); }
+    };
+
+    // Keeps the last `capacity` versions, and if max_age is not zero, only
+    // those which were replaced less than max_age ago.
+    explicit history_rcu_ptr(std::size_t capacity = 64,
+                             clock::duration max_age = clock::duration::zero(),
+                             shared_ptr<const T> initial = nullptr)
+        : log(capacity), max_age(max_age) {
+        auto s = ASPTraits::template make_shared<state>();
+        s->time = clock::now();
+        s->value = std::move(initial);
+        publish(*s);
+        current.reset(std::move(s));
+    }
+
+    history_rcu_ptr(const history_rcu_ptr&) = delete;
+    history_rcu_ptr& operator=(const history_rcu_ptr&) = delete;
+
+    snapshot read() const { return snapshot(current.read()); }
+
+    std::size_t capacity() const { return log.capacity(); }
+
+    // Reads the given version. Returns false if it has been evicted or is
+    // not published yet.
+    bool read_at(std::uint64_t version, snapshot& result) const {
+        auto s = current.read();
+        if (version >= s->version) {
+            if (version > s->version) return false;
+            result = snapshot(std::move(s));
+            return true;
+        }
+        auto r = log.load(version);
+        if (!in_history(r, version)) return false;
+        result = snapshot(std::move(r));
+        return true;
+    }
+
+    // Reads the version which was current at time t. Returns false if it
+    // has been evicted. It looks at the versions from the newest back, so
+    // it takes longer the further it goes back.
+    bool read_at(clock::time_point t, snapshot& result) const {
+        auto s = current.read();
+        if (s->time <= t) {
+            result = snapshot(std::move(s));
+            return true;
+        }
+        for (std::uint64_t v = s->version;
+             v-- > 0 && s->version - v < log.capacity();) {
+            auto r = log.load(v);
+            if (!in_history(r, v)) {
+                // Older versions are evicted too, unless this one is still
+                // being published.
+                if (r && r->version < v) continue;
+                return false;
+            }
+            if (r->time <= t) {
+                result = snapshot(std::move(r));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Publishes r as a new version. Returns the new version.
+    std::uint64_t reset(shared_ptr<const T> r) {
+        state published;
+        current.copy_update([&](state* s) {
+            s->value = r;
+            ++s->version;
+            s->time = clock::now();
+            published = *s;
+        });
+        publish(published);
+        return published.version;
+    }
+
+    // Like rcu_ptr::copy_update. Returns the new version.
+    template <typename R>
+    std::uint64_t copy_update(R&& fun) {
+        state published;
+        current.copy_update([&](state* s) {
+            shared_ptr<T> v;
+            if (s->value) {
+                // deep copy
+                v = detail::deep_copy<ASPTraits>(*s->value);
+            }
+            std::forward<R>(fun)(v.get());
+            s->value = shared_ptr<const T>(std::move(v));
+            ++s->version;
+            s->time = clock::now();
+            published = *s;
+        });
+        publish(published);
+        return published.version;
+    }
+};
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <detail/cache_line.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+// An rcu_ptr for small trivially copyable values, which are stored inline
+// instead of behind a shared_ptr.
+//
+// For an int or a small config struct, the allocation of a control block per
+// update and the reference counting per read of rcu_ptr cost much more than
+// copying the value itself. inline_rcu_ptr<T> has no allocation and no
+// reference count: read() returns a copy of the value and copy_update is a
+// CAS loop on the value.
+//
+// Values of 1, 2, 4 or 8 bytes are kept in a std::atomic<T>, larger ones (up
+// to a cache line) behind a seqlock: readers copy the value and retry if a
+// writer has changed it meanwhile, writers publish with a CAS on the
+// sequence number, so copy_update has the same optimistic retry semantics
+// as rcu_ptr::copy_update.
+
+namespace detail {
+namespace inline_value {
+
+template <typename T>
+class atomic_value {
+    std::atomic<T> value;
+
+public:
+    // What compare_exchange checks for: the value which was read.
+    using token = T;
+
+    explicit atomic_value(const T& v) : value(v) {}
+
+    T load() const { return value.load(std::memory_order_acquire); }
+
+    T load(token& t) const {
+        t = value.load(std::memory_order_acquire);
+        return t;
+    }
+
+    // Stores v if the value is still the one of t.
+    bool compare_exchange(token& t, const T& v) {
+        return value.compare_exchange_weak(
+            t, v, std::memory_order_release, std::memory_order_relaxed);
+    }
+
+    void store(const T& v) { value.store(v, std::memory_order_release); }
+};
+
+template <typename T>
+class seqlock_value {
+    static constexpr std::size_t words =
+        (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+    // Odd while a writer is writing the value.
+    std::atomic<std::uint64_t> seq{0};
+    // The value as relaxed atomic words, so that a reader which races with
+    // a writer reads torn words instead of having undefined behavior.
+    std::atomic<std::uint64_t> data[words];
+
+    std::uint64_t even_seq() const {
+        for (;;) {
+            std::uint64_t s = seq.load(std::memory_order_acquire);
+            if ((s & 1) == 0) return s;
+            std::this_thread::yield();
+        }
+    }
+
+    void write(const T& v) {
+        std::uint64_t w[words] = {};
+        std::memcpy(w, &v, sizeof(T));
+        for (std::size_t i = 0; i < words; ++i) {
+            data[i].store(w[i], std::memory_order_relaxed);
+        }
+    }
+
+public:
+    // What compare_exchange checks for: the sequence number of the value
+    // which was read.
+    using token = std::uint64_t;
+
+    explicit seqlock_value(const T& v) { write(v); }
+
+    T load() const {
+        token t;
+        return load(t);
+    }
+
+    T load(token& t) const {
+        for (;;) {
+            t = even_seq();
+            std::uint64_t w[words];
+            for (std::size_t i = 0; i < words; ++i) {
+                w[i] = data[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed) == t) {
+                T v;
+                std::memcpy(&v, w, sizeof(T));
+                return v;
+            }
+        }
+    }
+
+    // Stores v if no other writer has stored a value since t was read.
+    bool compare_exchange(token& t, const T& v) {
+        if (!seq.compare_exchange_strong(t, t + 1,
+                                         std::memory_order_relaxed)) {
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        write(v);
+        seq.store(t + 2, std::memory_order_release);
+        return true;
+    }
+
+    void store(const T& v) {
+        token t = even_seq();
+        while (!compare_exchange(t, v)) {
+            t = even_seq();
+        }
+    }
+};
+
+// Whether std::atomic<T> is used, it is lock-free for these sizes on the
+// platforms we target.
+template <typename T>
+struct fits_atomic
+    : std::integral_constant<bool, sizeof(T) == 1 || sizeof(T) == 2 ||
+                                       sizeof(T) == 4 || sizeof(T) == 8> {};
+
+template <typename T>
+using storage = std::conditional_t<fits_atomic<T>::value, atomic_value<T>,
+                                   seqlock_value<T> >;
+
+} // namespace inline_value
+} // namespace detail
+
+template <typename T>
+class inline_rcu_ptr {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "the value is copied bytewise, it must be trivially "
+                  "copyable");
+    static_assert(sizeof(T) <= detail::cache_line_size,
+                  "the value is copied on every read, use rcu_ptr for "
+                  "larger values");
+
+    detail::inline_value::storage<T> value;
+
+public:
+    using element_type = T;
+
+    // Whether the value is kept in a lock-free std::atomic<T> rather than
+    // behind a seqlock.
+    static constexpr bool is_atomic =
+        detail::inline_value::fits_atomic<T>::value;
+
+    inline_rcu_ptr() : value(T()) {}
+
+    explicit inline_rcu_ptr(const T& initial) : value(initial) {}
+
+    inline_rcu_ptr(const inline_rcu_ptr&) = delete;
+    inline_rcu_ptr& operator=(const inline_rcu_ptr&) = delete;
+
+    void operator=(const T& desired) { reset(desired); }
+
+    T read() const { return value.load(); }
+
+    void reset(const T& r) { value.store(r); }
+
+    // Like rcu_ptr::copy_update: fun(T*) is called with a copy of the
+    // current value, which is published if no other writer has published a
+    // value meanwhile. Otherwise fun is called again with a copy of the new
+    // value.
+    template <typename R>
+    void copy_update(R&& fun) {
+        typename detail::inline_value::storage<T>::token t;
+        T current = value.load(t);
+        for (;;) {
+            T r = current;
+            std::forward<R>(fun)(&r);
+            if (value.compare_exchange(t, r)) return;
+            current = value.load(t);
+        }
+    }
+};
+
+template <typename T>
+constexpr bool inline_rcu_ptr<T>::is_atomic;
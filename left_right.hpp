@@ -0,0 +1,131 @@
+#pragma once
+
+#include <detail/read_indicator.hpp>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+// Left-right concurrency control [Ramalhete, Correia: Left-Right: A
+// Concurrency Control Technique with Wait-Free Population Oblivious Reads].
+//
+// Keeps two instances of T. Readers always read the instance which is not
+// being modified, they never wait and never allocate. A writer applies its
+// modification to the instance the readers are not using, switches the
+// readers over to it, waits until the readers of the other instance are
+// gone, and then applies the same modification to the other instance.
+//
+// Compared to rcu_ptr there is no deep copy on update, the price is that
+// every modification runs twice and that writers wait for readers, so reads
+// should be short. Writers are serialized.
+//
+// The reader counters are cache line aligned, new allocates a left_right on
+// a cache line boundary; std::make_shared does not before C++17.
+template <typename T>
+class left_right : public detail::cache_aligned {
+
+    T instances[2]{};
+    std::atomic<int> read_index{0};
+    std::atomic<int> version_index{0};
+    mutable detail::read_indicator indicators[2];
+    std::mutex writer_mtx;
+
+public:
+    using element_type = T;
+
+    // Keeps the read-side critical section open as long as it is alive, and
+    // gives const access to the instance which was current at the time of
+    // the read. A writer can not complete while a read_handle exists. It
+    // may be moved to and released on another thread.
+    class read_handle {
+        const T* p = nullptr;
+        detail::read_indicator* indicator = nullptr;
+        std::size_t slot = 0; // the counter of indicator it arrived at
+
+        friend class left_right;
+        read_handle(const T* p, detail::read_indicator* indicator,
+                    std::size_t slot)
+            : p(p), indicator(indicator), slot(slot) {}
+
+    public:
+        read_handle() = default;
+        read_handle(const read_handle&) = delete;
+        read_handle& operator=(const read_handle&) = delete;
+        read_handle(read_handle&& other) noexcept
+            : p(other.p), indicator(other.indicator), slot(other.slot) {
+            other.p = nullptr;
+            other.indicator = nullptr;
+        }
+        read_handle& operator=(read_handle&& other) noexcept {
+            if (this != &other) {
+                release();
+                p = other.p;
+                indicator = other.indicator;
+                slot = other.slot;
+                other.p = nullptr;
+                other.indicator = nullptr;
+            }
+            return *this;
+        }
+        ~read_handle() { release(); }
+
+        const T* get() const noexcept { return p; }
+        const T& operator*() const noexcept { return *p; }
+        const T* operator->() const noexcept { return p; }
+        explicit operator bool() const noexcept { return p != nullptr; }
+
+    private:
+        void release() noexcept {
+            if (indicator) indicator->depart(slot);
+            indicator = nullptr;
+            p = nullptr;
+        }
+    };
+
+    left_right() = default;
+
+    explicit left_right(const T& value) : instances{value, value} {}
+
+    left_right(const left_right&) = delete;
+    left_right& operator=(const left_right&) = delete;
+    left_right(left_right&&) = delete;
+    left_right& operator=(left_right&&) = delete;
+
+    ~left_right() = default;
+
+    // Wait-free.
+    read_handle read() const {
+        detail::read_indicator* indicator =
+            &indicators[version_index.load(std::memory_order_seq_cst)];
+        std::size_t slot = indicator->arrive();
+        return {&instances[read_index.load(std::memory_order_seq_cst)],
+                indicator, slot};
+    }
+
+    // Applies the modification to both instances.
+    //
+    // @param fun is a lambda which receives a T*. It is called exactly twice,
+    // once for each instance, therefore it must be deterministic: called on
+    // equal instances it must leave them equal.
+    template <typename R>
+    void update(R&& fun) {
+        std::lock_guard<std::mutex> lock{writer_mtx};
+        const int current = read_index.load(std::memory_order_relaxed);
+        fun(&instances[1 - current]);
+        read_index.store(1 - current, std::memory_order_seq_cst);
+        toggle_version_and_wait();
+        std::forward<R>(fun)(&instances[current]);
+    }
+
+private:
+    // Waits until no reader may be reading the instance the readers have
+    // just been switched away from.
+    void toggle_version_and_wait() {
+        const int prev = version_index.load(std::memory_order_relaxed);
+        const int next = 1 - prev;
+        // Readers which arrived at `next` during the previous update can
+        // still read the old instance.
+        while (!indicators[next].is_empty()) std::this_thread::yield();
+        version_index.store(next, std::memory_order_seq_cst);
+        while (!indicators[prev].is_empty()) std::this_thread::yield();
+    }
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <rcu_ptr.hpp>
+#include <detail/version_ring.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// An rcu_ptr with a change feed.
+//
+// Every version has a number, and every copy_update records a delta, a user
+// defined description of its change, together with the version it creates.
+// The deltas of the last `capacity` versions are kept in a lock-free ring.
+// A subscriber consumes them in version order to maintain its derived state,
+// and falls back to the full snapshot when it has fallen further behind than
+// the ring reaches, or when a version was published by reset.
+template <typename T, typename Delta,
+          template <typename> class AtomicSharedPtr =
+              detail::__std::atomic_shared_ptr,
+          typename ASPTraits =
+              detail::atomic_shared_ptr_traits<AtomicSharedPtr> >
+class logged_rcu_ptr {
+public:
+    template <typename _T>
+    using shared_ptr = typename ASPTraits::template shared_ptr<_T>;
+
+private:
+    struct state {
+        std::uint64_t version = 0;
+        shared_ptr<const T> value;
+    };
+
+    struct record {
+        std::uint64_t version;
+        bool reset; // there is no delta
+        Delta delta;
+    };
+
+    rcu_ptr<state, AtomicSharedPtr, ASPTraits> current;
+    detail::version_ring<record, ASPTraits> log;
+
+    void publish(std::uint64_t version, bool reset, Delta&& delta) {
+        log.publish(ASPTraits::template make_shared<record>(
+            record{version, reset, std::move(delta)}));
+    }
+
+public:
+    // A version and its value.
+    class snapshot {
+        shared_ptr<const state> s;
+
+        friend class logged_rcu_ptr;
+        explicit snapshot(shared_ptr<const state> s) : s(std::move(s)) {}
+
+    public:
+        std::uint64_t version() const { return s->version; }
+        const shared_ptr<const T>& get() const { return s->value; }
+        const T& operator*() const { return *s->value; }
+        const T* operator->() const { return s->value.get(); }
+        explicit operator bool() const { return bool(s->value); }
+    };
+
+    class subscriber;
+
+    // Keeps the deltas of the last `capacity` versions.
+    explicit logged_rcu_ptr(std::size_t capacity = 1024,
+                            shared_ptr<const T> initial = nullptr)
+        : log(capacity) {
+        auto s = ASPTraits::template make_shared<state>();
+        s->value = std::move(initial);
+        current.reset(std::move(s));
+    }
+
+    logged_rcu_ptr(const logged_rcu_ptr&) = delete;
+    logged_rcu_ptr& operator=(const logged_rcu_ptr&) = delete;
+
+    snapshot read() const { return snapshot(current.read()); }
+
+    std::size_t capacity() const { return log.capacity(); }
+
+    // Publishes r as a new version without a delta, subscribers resync from
+    // the snapshot. Returns the new version.
+    std::uint64_t reset(shared_ptr<const T> r) {
+        std::uint64_t version = 0;
+        current.copy_update([&](state* s) {
+            s->value = r;
+            version = ++s->version;
+        });
+        publish(version, true, Delta());
+        return version;
+    }
+
+    // Like rcu_ptr::copy_update, but `fun` is called as fun(T*, Delta&) and
+    // fills in the delta of its change. The delta is value-initialized
+    // before every attempt. Returns the new version.
+    template <typename R>
+    std::uint64_t copy_update(R&& fun) {
+        std::uint64_t version = 0;
+        Delta delta;
+        current.copy_update([&](state* s) {
+            shared_ptr<T> v;
+            if (s->value) {
+                // deep copy
+                v = detail::deep_copy<ASPTraits>(*s->value);
+            }
+            delta = Delta();
+            std::forward<R>(fun)(v.get(), delta);
+            s->value = shared_ptr<const T>(std::move(v));
+            version = ++s->version;
+        });
+        publish(version, false, std::move(delta));
+        return version;
+    }
+};
+
+// Consumes the deltas of a logged_rcu_ptr from the version which is current
+// when it is created. A subscriber is used by one thread at a time.
+template <typename T, typename Delta,
+          template <typename> class AtomicSharedPtr, typename ASPTraits>
+class logged_rcu_ptr<T, Delta, AtomicSharedPtr, ASPTraits>::subscriber {
+    const logged_rcu_ptr* feed;
+    std::uint64_t next;
+
+public:
+    explicit subscriber(const logged_rcu_ptr& feed)
+        : feed(&feed), next(feed.read().version() + 1) {}
+
+    // The last version consumed.
+    std::uint64_t version() const { return next - 1; }
+
+    // Calls on_delta(version, const Delta&) for each version published since
+    // the last poll, in order. If a delta is not available, it calls
+    // on_snapshot(const snapshot&) with the current version instead and
+    // continues after it. Returns the number of calls.
+    template <typename OnDelta, typename OnSnapshot>
+    std::size_t poll(OnDelta&& on_delta, OnSnapshot&& on_snapshot) {
+        std::size_t calls = 0;
+        for (;; ++next, ++calls) {
+            auto r = feed->log.load(next);
+            if (r && r->version == next && !r->reset) {
+                on_delta(next, r->delta);
+            } else if (r && r->version >= next) {
+                // Overwritten by a later version, or published by reset.
+                snapshot s = feed->read();
+                on_snapshot(s);
+                next = s.version();
+            } else {
+                // Not published yet.
+                return calls;
+            }
+        }
+    }
+};
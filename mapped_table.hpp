@@ -0,0 +1,287 @@
+#pragma once
+
+#include <rcu_ptr.hpp>
+#include <detail/errno_error.hpp>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only tables of trivially copyable records in a flat file, mapped into
+// memory instead of parsed into heap objects (Linux only).
+//
+// The file is a header followed by the records at offset `data_offset`. A
+// mapped_table maps the whole file read-only and shared: loading it copies
+// nothing, and processes mapping the same file share the resident pages.
+// The mapping is unmapped when the mapped_table is destroyed, so when it is
+// published through an rcu_ptr the file stays mapped as long as a reader
+// holds the version.
+//
+// A mapped file must not be modified in place: readers of the mapped version
+// would see the change, or fault on truncated pages. New versions have to be
+// written to a new file and renamed over the old one, as write_mapped_table
+// does; the mapping keeps the old inode alive.
+
+namespace detail {
+
+struct mapped_table_header {
+    static const char* magic_value() { return "RCUTBL01"; }
+    char magic[8];
+    std::uint64_t record_size;
+    std::uint64_t count;
+};
+
+// Closes a file descriptor at the end of the scope.
+struct scoped_fd {
+    int fd;
+    explicit scoped_fd(int fd) : fd(fd) {}
+    scoped_fd(const scoped_fd&) = delete;
+    scoped_fd& operator=(const scoped_fd&) = delete;
+    ~scoped_fd() {
+        if (fd >= 0) ::close(fd);
+    }
+};
+
+} // namespace detail
+
+template <typename T>
+class mapped_table {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "records are used in place, they must be trivially "
+                  "copyable");
+
+public:
+    static constexpr std::size_t data_offset = 64;
+    static_assert(alignof(T) <= data_offset, "records are over-aligned");
+
+    using value_type = T;
+    using const_iterator = const T*;
+
+    // Maps the file at path. Throws std::system_error if it can not be
+    // mapped, and std::runtime_error if it is not a table of T.
+    explicit mapped_table(const std::string& path) {
+        detail::scoped_fd file(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+        if (file.fd < 0) throw detail::errno_error("open " + path);
+        struct stat st;
+        if (::fstat(file.fd, &st) != 0) {
+            throw detail::errno_error("fstat " + path);
+        }
+        length = static_cast<std::size_t>(st.st_size);
+        if (length < data_offset) {
+            throw std::runtime_error(path + ": too short for a table");
+        }
+        void* p = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, file.fd, 0);
+        if (p == MAP_FAILED) throw detail::errno_error("mmap " + path);
+        base = static_cast<const char*>(p);
+
+        detail::mapped_table_header header;
+        std::memcpy(&header, base, sizeof(header));
+        const char* error = nullptr;
+        if (std::memcmp(header.magic, header.magic_value(),
+                        sizeof(header.magic)) != 0) {
+            error = ": not a table";
+        } else if (header.record_size != sizeof(T)) {
+            error = ": record size mismatch";
+        } else if (header.count > (length - data_offset) / sizeof(T)) {
+            error = ": truncated";
+        }
+        if (error) {
+            ::munmap(const_cast<char*>(base), length);
+            throw std::runtime_error(path + error);
+        }
+        count = static_cast<std::size_t>(header.count);
+    }
+
+    mapped_table(const mapped_table&) = delete;
+    mapped_table& operator=(const mapped_table&) = delete;
+
+    ~mapped_table() { ::munmap(const_cast<char*>(base), length); }
+
+    const T* data() const {
+        return reinterpret_cast<const T*>(base + data_offset);
+    }
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T& operator[](std::size_t i) const { return data()[i]; }
+    const_iterator begin() const { return data(); }
+    const_iterator end() const { return data() + count; }
+
+private:
+    const char* base = nullptr;
+    std::size_t length = 0;
+    std::size_t count = 0;
+};
+
+// Writes a table file. It is written next to path and renamed over it, so
+// readers and watchers never see a partial file. Throws std::system_error.
+template <typename T>
+void write_mapped_table(const std::string& path, const T* records,
+                        std::size_t count) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "records must be trivially copyable");
+    std::string tmp = path + ".tmp";
+    detail::scoped_fd file(
+        ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    if (file.fd < 0) throw detail::errno_error("open " + tmp);
+
+    char head[mapped_table<T>::data_offset] = {};
+    detail::mapped_table_header header;
+    std::memcpy(header.magic, header.magic_value(), sizeof(header.magic));
+    header.record_size = sizeof(T);
+    header.count = count;
+    std::memcpy(head, &header, sizeof(header));
+
+    auto write_all = [&](const char* p, std::size_t n) {
+        while (n > 0) {
+            ssize_t written = ::write(file.fd, p, n);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                throw detail::errno_error("write " + tmp);
+            }
+            p += written;
+            n -= static_cast<std::size_t>(written);
+        }
+    };
+    write_all(head, sizeof(head));
+    write_all(reinterpret_cast<const char*>(records), count * sizeof(T));
+    if (::fsync(file.fd) != 0) throw detail::errno_error("fsync " + tmp);
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        throw detail::errno_error("rename " + tmp);
+    }
+}
+
+// Loads a table file into an rcu_ptr and optionally reloads it whenever the
+// file is replaced or rewritten.
+//
+// A reload which fails (e.g. the file is truncated) keeps the current version
+// and reports the error to the error handler.
+template <typename T,
+          template <typename> class AtomicSharedPtr =
+              detail::__std::atomic_shared_ptr,
+          typename ASPTraits =
+              detail::atomic_shared_ptr_traits<AtomicSharedPtr> >
+class mapped_table_loader {
+public:
+    using table = mapped_table<T>;
+    using rcu_ptr_type = rcu_ptr<table, AtomicSharedPtr, ASPTraits>;
+    using error_handler = std::function<void(const std::exception&)>;
+
+    mapped_table_loader(rcu_ptr_type& target, std::string path,
+                        error_handler on_error = error_handler())
+        : target(target), path(std::move(path)),
+          on_error(std::move(on_error)) {}
+
+    mapped_table_loader(const mapped_table_loader&) = delete;
+    mapped_table_loader& operator=(const mapped_table_loader&) = delete;
+
+    ~mapped_table_loader() { unwatch(); }
+
+    // Maps the file and publishes it. Throws if it can not be loaded.
+    void load() {
+        target.reset(ASPTraits::template make_shared<table>(path));
+        reloads.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Starts a thread which reloads the file when it changes.
+    // Throws std::system_error if inotify is not available.
+    void watch() {
+        if (watcher.joinable()) return;
+        inotify_fd = ::inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+        if (inotify_fd < 0) throw detail::errno_error("inotify_init1");
+        // We watch the directory, because the file is replaced by a rename.
+        std::string dir = ".", name = path;
+        auto slash = path.rfind('/');
+        if (slash != std::string::npos) {
+            dir = slash == 0 ? "/" : path.substr(0, slash);
+            name = path.substr(slash + 1);
+        }
+        if (::inotify_add_watch(inotify_fd, dir.c_str(),
+                                IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            auto error = detail::errno_error("inotify_add_watch " + dir);
+            ::close(inotify_fd);
+            throw error;
+        }
+        stop_fd = ::eventfd(0, EFD_CLOEXEC);
+        if (stop_fd < 0) {
+            auto error = detail::errno_error("eventfd");
+            ::close(inotify_fd);
+            throw error;
+        }
+        watcher = std::thread([this, name]() { watcher_fun(name); });
+    }
+
+    // Stops the watcher thread.
+    void unwatch() {
+        if (!watcher.joinable()) return;
+        std::uint64_t one = 1;
+        ssize_t r = ::write(stop_fd, &one, sizeof(one));
+        (void)r;
+        watcher.join();
+        ::close(stop_fd);
+        ::close(inotify_fd);
+    }
+
+    // The number of successful loads so far.
+    std::size_t load_count() const {
+        return reloads.load(std::memory_order_relaxed);
+    }
+
+private:
+    void watcher_fun(const std::string& name) {
+        alignas(inotify_event) char buffer[4096];
+        for (;;) {
+            pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+            if (::poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                report(detail::errno_error("poll"));
+                return;
+            }
+            if (fds[1].revents) return;
+
+            bool changed = false;
+            ssize_t n;
+            while ((n = ::read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+                for (char* p = buffer; p < buffer + n;) {
+                    auto* event = reinterpret_cast<inotify_event*>(p);
+                    if (event->len > 0 && name == event->name) changed = true;
+                    p += sizeof(inotify_event) + event->len;
+                }
+            }
+            if (!changed) continue;
+            try {
+                load();
+            } catch (const std::exception& e) {
+                report(e);
+            }
+        }
+    }
+
+    void report(const std::exception& e) {
+        if (on_error) on_error(e);
+    }
+
+    rcu_ptr_type& target;
+    const std::string path;
+    const error_handler on_error;
+    std::atomic<std::size_t> reloads{0};
+    int inotify_fd = -1;
+    int stop_fd = -1;
+    std::thread watcher;
+};
@@ -0,0 +1,85 @@
+// alloc_stats.cpp
+//
+// Replaces the global allocation functions to count the allocations of the
+// measured program. See memory::AllocStats.
+#include <measurements/memory.hpp>
+
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+
+namespace memory {
+
+std::atomic<bool> AllocStats::enabled{false};
+std::atomic<long long> AllocStats::allocations{0};
+std::atomic<long long> AllocStats::deallocations{0};
+std::atomic<long long> AllocStats::allocated_bytes{0};
+std::atomic<long long> AllocStats::live_bytes{0};
+std::atomic<long long> AllocStats::peak_live_bytes{0};
+
+std::atomic<long long> VersionCounter::live{0};
+std::atomic<long long> VersionCounter::peak{0};
+
+} // namespace memory
+
+namespace {
+
+void* counted_malloc(std::size_t size) {
+    void* p = std::malloc(size ? size : 1);
+    if (p && memory::AllocStats::enabled.load(std::memory_order_relaxed)) {
+        // The usable size is what we get back in counted_free.
+        long long bytes = malloc_usable_size(p);
+        memory::AllocStats::allocations.fetch_add(1,
+                                                  std::memory_order_relaxed);
+        memory::AllocStats::allocated_bytes.fetch_add(
+            bytes, std::memory_order_relaxed);
+        memory::update_peak(memory::AllocStats::peak_live_bytes,
+                            memory::AllocStats::live_bytes.fetch_add(
+                                bytes, std::memory_order_relaxed) +
+                                bytes);
+    }
+    return p;
+}
+
+void counted_free(void* p) noexcept {
+    if (p && memory::AllocStats::enabled.load(std::memory_order_relaxed)) {
+        memory::AllocStats::deallocations.fetch_add(1,
+                                                    std::memory_order_relaxed);
+        memory::AllocStats::live_bytes.fetch_sub(malloc_usable_size(p),
+                                                 std::memory_order_relaxed);
+    }
+    std::free(p);
+}
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    void* p = counted_malloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size) {
+    void* p = counted_malloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_malloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_malloc(size);
+}
+
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    counted_free(p);
+}
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    counted_free(p);
+}
@@ -0,0 +1,176 @@
+// deep_copy.cpp
+//
+// Compares the deep copy of copy_update for a large vector of PODs with the
+// copy constructor (std::allocator) and with the non-temporal stream copy
+// (detail::default_init_allocator):
+//  - the time of a copy, also split across threads by parallel_copy_update
+//    with std::threads and with the TBB workers,
+//  - the throughput of readers which work on a small hot data set while a
+//    writer keeps copying the large snapshot,
+//  - the time of a copy and the throughput of readers which scan the whole
+//    snapshot, with the snapshot in 4 KiB pages and in huge pages
+//    (detail::huge_page_allocator).
+//
+// Usage: measure_deep_copy [size_mb] [num_readers] [duration_ms]
+#include <rcu_ptr.hpp>
+#include <detail/huge_page_allocator.hpp>
+#include <detail/tbb_executor.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+// The data the readers keep in their caches, half of a typical L2.
+constexpr std::size_t hot_size = 512 * 1024 / sizeof(long);
+
+template <typename V>
+double copy_ms(std::size_t size) {
+    rcu_ptr<V> p(std::make_shared<V>(size, 1));
+    p.copy_update([](V*) {}); // warm up the allocator
+    const int rounds = 10;
+    auto start = clock_type::now();
+    for (int i = 0; i < rounds; ++i) {
+        p.copy_update([](V* v) { v->front() = 2; });
+    }
+    std::chrono::duration<double, std::milli> d = clock_type::now() - start;
+    return d.count() / rounds;
+}
+
+template <typename V, typename Executor>
+double parallel_copy_ms(std::size_t size, Executor executor) {
+    rcu_ptr<V> p(std::make_shared<V>(size, 1));
+    p.parallel_copy_update([](V*) {}, executor); // warm up
+    const int rounds = 10;
+    auto start = clock_type::now();
+    for (int i = 0; i < rounds; ++i) {
+        p.parallel_copy_update([](V* v) { v->front() = 2; }, executor);
+    }
+    std::chrono::duration<double, std::milli> d = clock_type::now() - start;
+    return d.count() / rounds;
+}
+
+// Returns the reads per second of all readers.
+template <typename V>
+double reads_per_sec(std::size_t size, int num_readers,
+                     std::chrono::milliseconds duration, bool writer) {
+    rcu_ptr<V> snapshot(std::make_shared<V>(size, 1));
+    std::vector<long> hot(hot_size, 1);
+    std::atomic<bool> stop{false};
+    std::atomic<long> reads{0};
+
+    std::vector<std::thread> threads;
+    for (int r = 0; r < num_readers; ++r) {
+        threads.emplace_back([&]() {
+            long n = 0, sum = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                sum += std::accumulate(hot.begin(), hot.end(), 0L);
+                ++n;
+            }
+            reads += n;
+            if (sum == 42) std::cout << "";
+        });
+    }
+    if (writer) {
+        threads.emplace_back([&]() {
+            while (!stop.load(std::memory_order_relaxed)) {
+                snapshot.copy_update([](V* v) { ++v->front(); });
+            }
+        });
+    }
+    std::this_thread::sleep_for(duration);
+    stop.store(true);
+    for (auto& t : threads) {
+        t.join();
+    }
+    return reads.load() * 1000.0 / duration.count();
+}
+
+// Returns the bytes per second which all readers scan, every read sums the
+// whole snapshot.
+template <typename V>
+double scan_bytes_per_sec(std::size_t size, int num_readers,
+                          std::chrono::milliseconds duration) {
+    rcu_ptr<V> snapshot(std::make_shared<V>(size, 1));
+    std::atomic<bool> stop{false};
+    std::atomic<long> scans{0};
+
+    std::vector<std::thread> threads;
+    for (int r = 0; r < num_readers; ++r) {
+        threads.emplace_back([&]() {
+            long n = 0, sum = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                auto v = snapshot.read();
+                sum += std::accumulate(v->begin(), v->end(), 0L);
+                ++n;
+            }
+            scans += n;
+            if (sum == 42) std::cout << "";
+        });
+    }
+    std::this_thread::sleep_for(duration);
+    stop.store(true);
+    for (auto& t : threads) {
+        t.join();
+    }
+    return scans.load() * 1000.0 * size * sizeof(typename V::value_type) /
+           duration.count();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::size_t size_mb = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    int num_readers = argc > 2 ? std::atoi(argv[2]) : 2;
+    std::chrono::milliseconds duration(argc > 3 ? std::atoi(argv[3]) : 2000);
+    std::size_t size = (size_mb << 20) / sizeof(long);
+
+    using copied = std::vector<long>;
+    using streamed = std::vector<long, detail::default_init_allocator<long>>;
+    using huge_pages = detail::huge_page_allocator<long>;
+    using huge = std::vector<long, huge_pages>;
+    using huge_streamed =
+        std::vector<long, detail::default_init_allocator<long, huge_pages>>;
+
+    std::cout << "snapshot: " << size_mb << " MiB\n";
+    std::cout << "copy ms, copy constructor: " << copy_ms<copied>(size)
+              << "\n";
+    std::cout << "copy ms, stream copy: " << copy_ms<streamed>(size) << "\n";
+    std::cout << "copy ms, copy constructor, huge pages: "
+              << copy_ms<huge>(size) << "\n";
+    std::cout << "copy ms, stream copy, huge pages: "
+              << copy_ms<huge_streamed>(size) << "\n";
+    std::cout << "copy ms, parallel, threads: "
+              << parallel_copy_ms<streamed>(size, detail::thread_executor())
+              << "\n";
+    std::cout << "copy ms, parallel, tbb: "
+              << parallel_copy_ms<streamed>(size, detail::tbb_executor())
+              << "\n";
+
+    std::cout << "reads/s, no writer: "
+              << reads_per_sec<copied>(size, num_readers, duration, false)
+              << "\n";
+    std::cout << "reads/s, copy constructor: "
+              << reads_per_sec<copied>(size, num_readers, duration, true)
+              << "\n";
+    std::cout << "reads/s, stream copy: "
+              << reads_per_sec<streamed>(size, num_readers, duration, true)
+              << "\n";
+
+    std::cout << "scan GiB/s, 4 KiB pages: "
+              << scan_bytes_per_sec<copied>(size, num_readers, duration) /
+                     (1 << 30)
+              << "\n";
+    std::cout << "scan GiB/s, huge pages: "
+              << scan_bytes_per_sec<huge>(size, num_readers, duration) /
+                     (1 << 30)
+              << "\n";
+}
@@ -1,73 +1,34 @@
 #!/usr/bin/env python
 # -*- coding: utf-8 -*-
 import argparse
-import os
-import re
-import locale
 from decimal import Decimal
 
 from matplotlib import rc
 import matplotlib
 import matplotlib.pyplot as plt
 
+from results import load_measures
+
 dot_line_formats = {
     'std_mutex': ('bs', '-b'),
     'tbb_srw_mutex': ('rd', '-r'),
     'tbb_qrw_mutex': ('ro', '-r'),
     'rcuptr': ('gv', '-g'),
     'rcuptr_jss': ('g^', '-g'),
+    'rcuptr_intrusive': ('g>', '-g'),
+    'rcuptr_distributed': ('gD', '-g'),
+    'rcuptr_arena': ('g<', '-g'),
+    'rcuptr_huge_pages': ('gh', '-g'),
+    'rcuptr_single_writer': ('g*', '-g'),
+    'left_right': ('m<', '-m'),
+    'rcu_hash_map': ('yo', '-y'),
+    'rcu_btree': ('ys', '-y'),
     'urcu': ('c*', '-c'),
     'urcu_mb': ('c+', '-c'),
     'urcu_bp': ('cx', '-c'),
 }
 
 
-# Represents one measurement configuration.
-class MeasureKey:
-
-    def __init__(
-            self,
-            test_bin,
-            vec_size,
-            num_all_readers,
-            num_readers,
-            num_writers):
-        self.test_bin = test_bin
-        self.num_all_readers = num_all_readers
-        self.vec_size = vec_size
-        self.num_readers = num_readers
-        self.num_writers = num_writers
-
-    def __str__(self):
-        return (self.test_bin +
-                " " +
-                str(self.vec_size) +
-                " " +
-                str(self.num_all_readers) +
-                " " +
-                str(self.num_readers) +
-                " " +
-                str(self.num_writers))
-
-    def __hash__(self):
-        return self.__str__().__hash__()
-
-    def __eq__(self, other):
-        return self.__str__().__eq__(other.__str__())
-
-
-# We have multiple measurement values for the same configuration (i.e.
-# MeasureKey).
-class MeasureIterations:
-
-    def __init__(self):
-        self.reader_sum = []
-        self.writer_sum = []
-
-    def __str__(self):
-        return str(self.reader_sum)
-
-
 class ChartLine:
 
     def __init__(self):
@@ -89,7 +50,9 @@ def getAverage(l):
 # Get a more verbose better reading label to a value
 def getYlabel(value):
     m = {'reader_sum': u"Number of Read Operations * $10^6$ / second",
-         'writer_sum': 'Number of Write Operations * $10^5$ / second'}
+         'writer_sum': 'Number of Write Operations * $10^5$ / second',
+         'reader_ns_per_op': 'Read Latency (ns)',
+         'writer_ns_per_op': 'Write Latency (ns)'}
     return m[value]
 
 
@@ -177,7 +140,9 @@ def main():
     parser = argparse.ArgumentParser()
     parser.add_argument('--result_dir', help='path of result dir',
                         required=True)
-    parser.add_argument('--value', required=True, choices=['reader_sum', 'writer_sum'])
+    parser.add_argument('--value', required=True,
+                        choices=['reader_sum', 'writer_sum',
+                                 'reader_ns_per_op', 'writer_ns_per_op'])
     parser.add_argument('--skip_urcu', action='store_true')
     parser.add_argument('--skip_mtx', action='store_true')
     parser.add_argument('--latex', action='store_true')
@@ -191,34 +156,7 @@ def main():
         rc('font', **{'family': 'serif', 'serif': ['Computer Modern Roman']})
         matplotlib.rcParams.update({'font.size': 15})
 
-    patterns = [
-        (re.compile("reader sum: ([\d|\.]+)"), 'reader_sum'),
-        (re.compile("writer sum: ([\d|\.]+)"), 'writer_sum'),
-    ]
-
-    # Aggregate the values in each files into a dict, where the key is
-    # MeasureKey, and the value is MeasureIterations.
-    # We append the found values in each measureIteration to the specific list.
-    measures = dict()
-    for file in os.listdir(args.result_dir):
-        basename = os.path.splitext(file)[0]
-        elements = basename.split('__')
-        key = MeasureKey(elements[0], elements[1], elements[2],
-                         elements[3], elements[4])
-        # skip measures when number of readers are below a certain limit
-        #if int(key.num_readers) < 5:
-            #continue
-        if key not in measures:
-            measures[key] = MeasureIterations()
-        measureIt = measures[key]
-        for _, line in enumerate(open(os.path.join(args.result_dir, file))):
-            for pattern, attr in patterns:
-                for match in re.finditer(pattern, line):
-                    value = match.groups()[0]
-                    locale.setlocale(locale.LC_NUMERIC, '')
-                    values = getattr(measureIt, attr)
-                    values.append(int(locale.atof(value)))
-                    setattr(measureIt, attr, values)
+    measures = load_measures(args.result_dir)
 
     # slow readers too
     """
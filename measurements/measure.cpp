@@ -3,6 +3,9 @@
 #include <iostream>
 #include <mutex>
 #include <numeric>
+#include <left_right.hpp>
+#include <rcu_btree.hpp>
+#include <rcu_hash_map.hpp>
 #include <tests/rcu_ptr_under_test.hpp>
 #include <thread>
 #include <vector>
@@ -24,151 +27,278 @@
   #include <urcu-bp.h>
 #endif
 
-class XRcuPtr {
-    rcu_ptr_under_test<std::vector<int>> v;
-    const int default_value = 1;
+#include <measurements/memory.hpp>
+#include <measurements/perf_counters.hpp>
+#include <measurements/report.hpp>
+#include <measurements/workload.hpp>
+
+// The operations of the driver expressed in terms of the payload. X provides
+// `read(f)` which calls `f` with a const reference to the current data, and
+// `update(f)` which calls `f` with a reference to the data to be modified.
+template <typename X, typename Payload>
+struct PayloadOps {
+    int read_one(std::size_t key) const {
+        return self().read([key](const typename Payload::type& p) {
+            return Payload::read_one(p, key);
+        });
+    }
+    int read_all() const {
+        return self().read([](const typename Payload::type& p) {
+            return Payload::read_all(p);
+        });
+    }
+    void update_one(std::size_t key, int value) {
+        self().update([=](typename Payload::type& p) {
+            Payload::update_one(p, key, value);
+        });
+    }
+    void update_all(int value) {
+        self().update([=](typename Payload::type& p) {
+            Payload::update_all(p, value);
+        });
+    }
+
+private:
+    const X& self() const { return static_cast<const X&>(*this); }
+    X& self() { return static_cast<X&>(*this); }
+};
+
+template <typename Payload>
+class XRcuPtr : public PayloadOps<XRcuPtr<Payload>, Payload> {
+    using value_type = typename Payload::type;
+#ifdef X_SINGLE_WRITER
+    // Only valid with one writer thread.
+    rcu_ptr_under_test<value_type, detail::single_writer> v;
+#else
+    rcu_ptr_under_test<value_type> v;
+#endif
 
 public:
-    XRcuPtr(size_t vec_size)
-        : v(asp_traits::make_shared<std::vector<int>>(vec_size,
-                                                      default_value)) {}
+    XRcuPtr(std::size_t size)
+        : v(asp_traits::make_shared<value_type>(Payload::make(size))) {}
 
-    int read_one(unsigned index) const {
-        asp_traits::shared_ptr<const std::vector<int>> local_copy = v.read();
-        assert(index < local_copy->size());
-        return (*local_copy)[index];
-    }
-    int read_all() const { // sum
-        asp_traits::shared_ptr<const std::vector<int>> local_copy = v.read();
-        return std::accumulate(local_copy->begin(), local_copy->end(), 0);
+    template <typename F>
+    int read(F&& f) const {
+        asp_traits::shared_ptr<const value_type> local_copy = v.read();
+        return f(*local_copy);
     }
 
-    void update_all(int value) {
-        v.copy_update([=](std::vector<int>* copy) {
-            for (auto& e : *copy) {
-                e = value;
-            }
-        });
+    template <typename F>
+    void update(F&& f) {
+        v.copy_update([&f](value_type* copy) { f(*copy); });
     }
 };
 
-class XStdMutex {
-    std::vector<int> v;
-    const int default_value = 1;
+template <typename Payload>
+class XStdMutex : public PayloadOps<XStdMutex<Payload>, Payload> {
+    using value_type = typename Payload::type;
+    value_type v;
     mutable std::mutex m;
 
 public:
-    XStdMutex(size_t vec_size) : v(vec_size, default_value) {}
+    XStdMutex(std::size_t size) : v(Payload::make(size)) {}
 
-    int read_one(unsigned index) const {
+    template <typename F>
+    int read(F&& f) const {
         std::lock_guard<std::mutex> lock{m};
-        assert(index < v.size());
-        return v[index];
-    }
-    int read_all() const { // sum
-        std::lock_guard<std::mutex> lock{m};
-        return std::accumulate(v.begin(), v.end(), 0);
+        return f(v);
     }
 
-    void update_all(int value) {
+    template <typename F>
+    void update(F&& f) {
         std::lock_guard<std::mutex> lock{m};
-        for (auto& e : v) {
-            e = value;
-        }
+        f(v);
     }
 };
 
-class XTbbQueuingRwMutex {
-    std::vector<int> v;
-    const int default_value = 1;
+template <typename Payload>
+class XTbbQueuingRwMutex
+    : public PayloadOps<XTbbQueuingRwMutex<Payload>, Payload> {
+    using value_type = typename Payload::type;
+    value_type v;
     mutable tbb::queuing_rw_mutex m;
 
 public:
-    XTbbQueuingRwMutex(size_t vec_size) : v(vec_size, default_value) {}
+    XTbbQueuingRwMutex(std::size_t size) : v(Payload::make(size)) {}
 
-    int read_one(unsigned index) const {
+    template <typename F>
+    int read(F&& f) const {
         tbb::queuing_rw_mutex::scoped_lock lock{m, false}; // read lock
-        assert(index < v.size());
-        return v[index];
-    }
-    int read_all() const {                                 // sum
-        tbb::queuing_rw_mutex::scoped_lock lock{m, false}; // read lock
-        return std::accumulate(v.begin(), v.end(), 0);
+        return f(v);
     }
 
-    void update_all(int value) {
+    template <typename F>
+    void update(F&& f) {
         tbb::queuing_rw_mutex::scoped_lock lock{m}; // write lock
-        for (auto& e : v) {
-            e = value;
-        }
+        f(v);
     }
 };
 
-class XTbbSpinRwMutex {
-    std::vector<int> v;
-    const int default_value = 1;
+template <typename Payload>
+class XTbbSpinRwMutex : public PayloadOps<XTbbSpinRwMutex<Payload>, Payload> {
+    using value_type = typename Payload::type;
+    value_type v;
     mutable tbb::spin_rw_mutex m;
 
 public:
-    XTbbSpinRwMutex(size_t vec_size) : v(vec_size, default_value) {}
+    XTbbSpinRwMutex(std::size_t size) : v(Payload::make(size)) {}
 
-    int read_one(unsigned index) const {
+    template <typename F>
+    int read(F&& f) const {
         tbb::spin_rw_mutex::scoped_lock lock{m, false}; // read lock
-        assert(index < v.size());
-        return v[index];
+        return f(v);
     }
-    int read_all() const {                              // sum
-        tbb::spin_rw_mutex::scoped_lock lock{m, false}; // read lock
-        return std::accumulate(v.begin(), v.end(), 0);
+
+    template <typename F>
+    void update(F&& f) {
+        tbb::spin_rw_mutex::scoped_lock lock{m}; // write lock
+        f(v);
     }
+};
 
+template <typename Payload>
+class XLeftRight : public PayloadOps<XLeftRight<Payload>, Payload> {
+    using value_type = typename Payload::type;
+    left_right<value_type> v;
+
+public:
+    XLeftRight(std::size_t size) : v(Payload::make(size)) {}
+
+    template <typename F>
+    int read(F&& f) const {
+        auto local = v.read();
+        return f(*local);
+    }
+
+    // The payload updates assign values, so they can be applied to both
+    // instances.
+    template <typename F>
+    void update(F&& f) {
+        v.update([&f](value_type* p) { f(*p); });
+    }
+};
+
+// Keeps `size` int keys in an rcu_hash_map, so an update of one element
+// copies one bucket only. It does not use the payload, main runs it with the
+// unordered_map payload only. Reading or updating all elements visits every
+// key.
+template <typename Payload>
+class XRcuHashMap {
+    rcu_hash_map<int, int> m;
+    const std::size_t size;
+
+public:
+    XRcuHashMap(std::size_t size) : m(size), size(size) {
+        for (std::size_t i = 0; i < size; ++i) {
+            m.insert_or_assign(static_cast<int>(i), 1);
+        }
+    }
+
+    int read_one(std::size_t key) const {
+        int value = 0;
+        m.find(static_cast<int>(key), value);
+        return value;
+    }
+    int read_all() const {
+        int sum = 0;
+        for (std::size_t i = 0; i < size; ++i) {
+            sum += read_one(i);
+        }
+        return sum;
+    }
+    void update_one(std::size_t key, int value) {
+        m.insert_or_assign(static_cast<int>(key), value);
+    }
     void update_all(int value) {
-        tbb::spin_rw_mutex::scoped_lock lock{m}; // write lock
-        for (auto& e : v) {
-            e = value;
+        for (std::size_t i = 0; i < size; ++i) {
+            update_one(i, value);
         }
     }
+
+    // There is no snapshot of the whole map, a holder keeps the version of
+    // a single value alive.
+    template <typename F>
+    int read(F&& f) const {
+        int result = 0;
+        m.visit(0, [&](const int& v) { result = f(v); });
+        return result;
+    }
 };
 
-class XURCU {
-    std::vector<int>* v;
-    const int default_value = 1;
-    mutable std::mutex m; // to support concurrent writers
+// Keeps `size` int keys in an rcu_btree, so an update of one element copies
+// one path of the tree only. It does not use the payload, main runs it with
+// the map payload only. Reading all elements is a scan of a snapshot,
+// updating all elements updates every key.
+template <typename Payload>
+class XRcuBtree {
+    rcu_btree<int, int> t;
+    const std::size_t size;
 
 public:
-    XURCU(size_t vec_size) : v(new std::vector<int>(vec_size, default_value)) {}
+    XRcuBtree(std::size_t size) : size(size) {
+        for (std::size_t i = 0; i < size; ++i) {
+            t.insert_or_assign(static_cast<int>(i), 1);
+        }
+    }
 
-    int read_one(unsigned index) const {
-        rcu_read_lock();
-        const std::vector<int>* local_copy = rcu_dereference(v);
-        assert(index < local_copy->size());
-        int result = (*local_copy)[index];
-        rcu_read_unlock();
-        return result;
+    int read_one(std::size_t key) const {
+        int value = 0;
+        t.find(static_cast<int>(key), value);
+        return value;
+    }
+    int read_all() const {
+        int sum = 0;
+        for (const auto& e : t.read()) {
+            sum += e.second;
+        }
+        return sum;
+    }
+    void update_one(std::size_t key, int value) {
+        t.insert_or_assign(static_cast<int>(key), value);
     }
-    int read_all() const { // sum
+    void update_all(int value) {
+        for (std::size_t i = 0; i < size; ++i) {
+            update_one(i, value);
+        }
+    }
+
+    template <typename F>
+    int read(F&& f) const {
+        auto snapshot = t.read();
+        return f(snapshot);
+    }
+};
+
+template <typename Payload>
+class XURCU : public PayloadOps<XURCU<Payload>, Payload> {
+    using value_type = typename Payload::type;
+    value_type* v;
+    std::mutex m; // to support concurrent writers
+
+public:
+    XURCU(std::size_t size) : v(new value_type(Payload::make(size))) {}
+
+    template <typename F>
+    int read(F&& f) const {
         rcu_read_lock();
-        const std::vector<int>* local_copy = rcu_dereference(v);
-        int result = std::accumulate(local_copy->begin(), local_copy->end(), 0);
+        const value_type* local_copy = rcu_dereference(v);
+        int result = f(*local_copy);
         rcu_read_unlock();
         return result;
     }
 
-    void update_all(int value) {
+    template <typename F>
+    void update(F&& f) {
         std::lock_guard<std::mutex> lock{m}; // support concurrent writers
 
-        rcu_read_lock();
-        std::vector<int>* local_copy = rcu_dereference(v);
-        std::vector<int>* local_deep_copy = new std::vector<int>(*local_copy);
-        rcu_read_unlock();
+        // We are the only writer, so the current version can not go away.
+        value_type* local_copy = v;
+        value_type* local_deep_copy = new value_type(*local_copy);
+        f(*local_deep_copy);
 
-        assert(index < copy->size());
-        for (auto& e : *local_deep_copy) {
-            e = ++value;
-        }
+        rcu_assign_pointer(v, local_deep_copy);
         synchronize_rcu();
         delete local_copy;
-        rcu_assign_pointer(v, local_deep_copy);
     }
 
     ~XURCU() {
@@ -177,72 +307,149 @@ public:
     }
 };
 
-class RoundRobin {
-    long long i = 0;
-    unsigned size;
-
-public:
-    RoundRobin(unsigned size) : size(size) {}
-    unsigned next() { return i++ % size; }
-};
-
 template <typename X>
 struct Driver {
     X x;
+    const workload::Options& opts;
+    std::shared_ptr<const std::vector<double>> zipf_cdf;
     std::atomic<bool> stop = ATOMIC_FLAG_INIT;
-    unsigned vec_size;
     std::mutex finish_mtx;
     std::vector<long long> reader_cycles;
     std::vector<long long> writer_cycles;
+    // Hardware counters of the measured loops and the number of operations
+    // they cover. The mixed threads can not attribute them to reads or
+    // writes, so they have their own sum.
+    struct PerfSum {
+        perf::Counts counts;
+        long long ops = 0;
+    };
+    PerfSum reader_perf, writer_perf, mixed_perf;
+    std::atomic<int> sink{0}; // keeps the reads from being optimized out
+    double elapsed_ms = 0;
+
+    Driver(const workload::Options& opts) : x(opts.size), opts(opts) {
+        if (opts.keys == workload::KeyDistribution::zipf) {
+            zipf_cdf = workload::make_zipf_cdf(opts.size, opts.zipf_s);
+        }
+    }
 
-    Driver(unsigned vec_size)
-        : x(vec_size), vec_size(vec_size) {}
+    workload::KeyGenerator make_keys() const {
+        return {opts.keys, opts.size, zipf_cdf};
+    }
 
     void timer_fun() {
-        using namespace std::chrono_literals;
         auto start = std::chrono::high_resolution_clock::now();
-        std::this_thread::sleep_for(1s);
+        std::this_thread::sleep_for(opts.duration);
         auto end = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double, std::milli> elapsed = end - start;
         stop.store(true, std::memory_order_relaxed);
-        std::cout << "Waited " << elapsed.count() << " ms\n";
+        elapsed_ms = elapsed.count();
+        if (!opts.json) std::cout << "Waited " << elapsed_ms << " ms\n";
+    }
+
+    void write(workload::KeyGenerator& keys, int value) {
+        if (opts.write_all) {
+            x.update_all(value);
+        } else {
+            x.update_one(keys.next(), value);
+        }
+    }
+
+    void finish(std::vector<long long>& cycles_of, long long cycles,
+                int result) {
+        sink.fetch_add(result, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(finish_mtx);
+        cycles_of.push_back(cycles);
+    }
+
+    void finish(PerfSum& perf_of, const perf::Counts& counts, long long ops) {
+        std::lock_guard<std::mutex> lock(finish_mtx);
+        perf_of.counts += counts;
+        perf_of.ops += ops;
     }
 
     void reader_fun() {
         long long cycles = 0;
+        int result = 0;
+        perf::ThreadCounters counters;
+        counters.start();
         while (!stop.load(std::memory_order_relaxed)) {
-            x.read_all();
+            result += x.read_all();
             ++cycles;
         }
-        {
-            std::lock_guard<std::mutex> lock(finish_mtx);
-            reader_cycles.push_back(cycles);
-        }
+        finish(reader_perf, counters.stop(), cycles);
+        finish(reader_cycles, cycles, result);
     }
 
     void one_reader_fun() {
         long long cycles = 0;
-        RoundRobin rr{vec_size};
+        int result = 0;
+        auto keys = make_keys();
+        perf::ThreadCounters counters;
+        counters.start();
         while (!stop.load(std::memory_order_relaxed)) {
-            x.read_one(rr.next());
+            result += x.read_one(keys.next());
             ++cycles;
         }
-        {
-            std::lock_guard<std::mutex> lock(finish_mtx);
-            reader_cycles.push_back(cycles);
-        }
+        finish(reader_perf, counters.stop(), cycles);
+        finish(reader_cycles, cycles, result);
     }
 
     void writer_fun() {
         long long cycles = 0;
+        auto keys = make_keys();
+        workload::BurstPacer pacer{opts.burst, opts.burst_pause};
+        perf::ThreadCounters counters;
+        counters.start();
         while (!stop.load(std::memory_order_relaxed)) {
-            x.update_all(0);
+            write(keys, 0);
             ++cycles;
+            pacer.after_write();
         }
-        {
-            std::lock_guard<std::mutex> lock(finish_mtx);
-            writer_cycles.push_back(cycles);
+        finish(writer_perf, counters.stop(), cycles);
+        finish(writer_cycles, cycles, 0);
+    }
+
+    // Takes a snapshot and keeps it for the configured hold time, as a slow
+    // reader would. For the RCU implementations this keeps old versions
+    // alive, for the lock based ones it blocks the writers.
+    void holder_fun() {
+        long long cycles = 0;
+        int result = 0;
+        perf::ThreadCounters counters;
+        counters.start();
+        while (!stop.load(std::memory_order_relaxed)) {
+            result += x.read([this](const auto& p) {
+                std::this_thread::sleep_for(opts.hold);
+                return static_cast<int>(sizeof(p));
+            });
+            ++cycles;
         }
+        finish(reader_perf, counters.stop(), cycles);
+        finish(reader_cycles, cycles, result);
+    }
+
+    // Reads single elements and writes in the configured ratio. Reads and
+    // writes are accounted separately.
+    void mixed_fun() {
+        long long read_cycles = 0, write_cycles = 0;
+        int result = 0;
+        auto keys = make_keys();
+        workload::OperationMix mix{opts.mix_reads, opts.mix_writes};
+        perf::ThreadCounters counters;
+        counters.start();
+        while (!stop.load(std::memory_order_relaxed)) {
+            if (mix.next_is_read()) {
+                result += x.read_one(keys.next());
+                ++read_cycles;
+            } else {
+                write(keys, 0);
+                ++write_cycles;
+            }
+        }
+        finish(mixed_perf, counters.stop(), read_cycles + write_cycles);
+        finish(reader_cycles, read_cycles, result);
+        finish(writer_cycles, write_cycles, 0);
     }
 
     void print_stats() {
@@ -265,58 +472,99 @@ struct Driver {
                                            ? writer_sum / writer_cycles.size()
                                            : 0)
                   << "\n";
+        print_perf("reader", reader_perf);
+        print_perf("writer", writer_perf);
+        print_perf("mixed", mixed_perf);
     }
-};
 
-int main(int argc, char** argv) {
-    if (argc != 5) {
-        std::cerr << "Wrong program args!\n";
-        exit(-1);
+    static void print_perf(const char* role, const PerfSum& perf) {
+        if (perf.ops == 0) return;
+        for (int e = 0; e < perf::num_events; ++e) {
+            if (!perf.counts.valid[e]) continue;
+            std::cout << role << " " << perf::event_name(e) << "/op: "
+                      << static_cast<double>(perf.counts.values[e]) / perf.ops
+                      << (perf.counts.scaled[e] ? " (scaled)" : "") << "\n";
+        }
     }
-    unsigned vec_size = atoi(argv[1]);
-    assert(vec_size >= 1);
-    unsigned num_all_readers = atoi(argv[2]);
-    unsigned num_one_readers = atoi(argv[3]);
-    unsigned num_writers = atoi(argv[4]);
 
+    static void report_perf(report::JsonObject& json, const char* role,
+                            const PerfSum& perf) {
+        if (perf.ops == 0) return;
+        for (int e = 0; e < perf::num_events; ++e) {
+            if (!perf.counts.valid[e]) continue;
+            std::string key = std::string(role) + "_" + perf::event_name(e);
+            json.add(key + "_per_op",
+                     static_cast<double>(perf.counts.values[e]) / perf.ops);
+            json.add(key + "_scaled", perf.counts.scaled[e]);
+        }
+    }
+
+    // Average time a thread spent on one operation.
+    double ns_per_op(const std::vector<long long>& cycles) const {
+        long long sum = std::accumulate(cycles.begin(), cycles.end(), 0ll);
+        return sum > 0 ? elapsed_ms * 1e6 * cycles.size() / sum : 0;
+    }
+
+    void report(report::JsonObject& json) const {
+        json.add("elapsed_ms", elapsed_ms);
+        json.add("reader_cycles", reader_cycles);
+        json.add("writer_cycles", writer_cycles);
+        json.add("reader_sum", std::accumulate(reader_cycles.begin(),
+                                               reader_cycles.end(), 0ll));
+        json.add("writer_sum", std::accumulate(writer_cycles.begin(),
+                                               writer_cycles.end(), 0ll));
+        json.add("reader_ns_per_op", ns_per_op(reader_cycles));
+        json.add("writer_ns_per_op", ns_per_op(writer_cycles));
+        report_perf(json, "reader", reader_perf);
+        report_perf(json, "writer", writer_perf);
+        report_perf(json, "mixed", mixed_perf);
+    }
+};
+
+template <typename Payload>
 #ifdef X_STD_MUTEX
-    Driver<XStdMutex> driver{vec_size};
+using XImpl = XStdMutex<Payload>;
 #elif defined X_TBB_QRW_MUTEX
-    Driver<XTbbQueuingRwMutex> driver{vec_size};
+using XImpl = XTbbQueuingRwMutex<Payload>;
 #elif defined X_TBB_SRW_MUTEX
-    Driver<XTbbSpinRwMutex> driver{vec_size};
+using XImpl = XTbbSpinRwMutex<Payload>;
+#elif defined X_LEFT_RIGHT
+using XImpl = XLeftRight<Payload>;
+#elif defined X_RCU_HASH_MAP
+using XImpl = XRcuHashMap<Payload>;
+#elif defined X_RCU_BTREE
+using XImpl = XRcuBtree<Payload>;
 #elif defined X_URCU
-    Driver<XURCU> driver{vec_size};
+using XImpl = XURCU<Payload>;
 #else
-    Driver<XRcuPtr> driver{vec_size};
+using XImpl = XRcuPtr<Payload>;
 #endif
 
+template <typename Payload>
+void run(const workload::Options& opts, report::JsonObject& json) {
+    if (!opts.json) std::cout << "payload: " << Payload::name() << "\n";
+    Driver<XImpl<Payload>> driver{opts};
+
     std::thread timer_thread([&driver]() { driver.timer_fun(); });
     std::vector<std::thread> reader_threads;
     std::vector<std::thread> writer_threads;
 
-    rcu_init();
-    for (unsigned i = 0; i < num_all_readers; ++i) {
-        reader_threads.push_back(std::thread([&driver]() {
-            rcu_register_thread();
-            driver.reader_fun();
-            rcu_unregister_thread();
-        }));
-    }
-    for (unsigned i = 0; i < num_one_readers; ++i) {
-        reader_threads.push_back(std::thread([&driver]() {
-            rcu_register_thread();
-            driver.one_reader_fun();
-            rcu_unregister_thread();
-        }));
-    }
-    for (unsigned i = 0; i < num_writers; ++i) {
-        writer_threads.push_back(std::thread([&driver]() {
-            rcu_register_thread();
-            driver.writer_fun();
-            rcu_unregister_thread();
-        }));
-    }
+    auto spawn = [&driver](std::vector<std::thread>& threads, unsigned n,
+                           void (Driver<XImpl<Payload>>::*fun)()) {
+        for (unsigned i = 0; i < n; ++i) {
+            threads.push_back(std::thread([&driver, fun]() {
+                rcu_register_thread();
+                (driver.*fun)();
+                rcu_unregister_thread();
+            }));
+        }
+    };
+    using D = Driver<XImpl<Payload>>;
+    spawn(reader_threads, opts.num_all_readers, &D::reader_fun);
+    spawn(reader_threads, opts.num_one_readers, &D::one_reader_fun);
+    spawn(writer_threads, opts.num_writers, &D::writer_fun);
+    spawn(writer_threads, opts.num_mixed, &D::mixed_fun);
+    spawn(reader_threads, opts.num_holders, &D::holder_fun);
 
     timer_thread.join();
     for (auto& t : reader_threads) {
@@ -325,7 +573,83 @@ int main(int argc, char** argv) {
     for (auto& t : writer_threads) {
         t.join();
     }
-    driver.print_stats();
+    if (opts.json) {
+        driver.report(json);
+    } else {
+        driver.print_stats();
+    }
+}
+
+template <typename Payload>
+void run_payload(const workload::Options& opts) {
+    report::JsonObject json;
+    json.add("payload", Payload::name());
+    json.add("size", opts.size);
+    json.add("num_all_readers", opts.num_all_readers);
+    json.add("num_one_readers", opts.num_one_readers);
+    json.add("num_writers", opts.num_writers);
+    json.add("num_mixed", opts.num_mixed);
+    json.add("num_holders", opts.num_holders);
+    if (opts.memory) {
+        memory::AllocStats::enabled.store(true);
+        run<memory::Versioned<Payload>>(opts, json);
+        memory::AllocStats::enabled.store(false);
+        if (opts.json) {
+            memory::report(json);
+        } else {
+            memory::print_stats();
+        }
+    } else {
+        run<Payload>(opts, json);
+    }
+    if (opts.json) json.print(std::cout);
+}
+
+int main(int argc, char** argv) {
+    workload::Options opts;
+    if (!workload::parse_options(argc, argv, opts)) {
+        std::cerr << "Wrong program args!\n";
+        workload::print_usage(argv[0]);
+        exit(-1);
+    }
+
+    std::string perf_error = perf::ThreadCounters::probe();
+    if (!perf_error.empty()) {
+        std::cerr << "Hardware performance counters are not available: "
+                  << perf_error << "\n";
+    }
+
+#ifdef X_RCU_HASH_MAP
+    if (opts.payload != workload::PayloadKind::unordered_map) {
+        std::cerr << "The hash map supports --payload=unordered_map only\n";
+        exit(-1);
+    }
+#endif
+#ifdef X_RCU_BTREE
+    if (opts.payload != workload::PayloadKind::map) {
+        std::cerr << "The btree supports --payload=map only\n";
+        exit(-1);
+    }
+#endif
+
+    rcu_init();
+    switch (opts.payload) {
+        case workload::PayloadKind::vector:
+            run_payload<workload::VectorPayload>(opts);
+            break;
+        case workload::PayloadKind::map:
+            run_payload<workload::MapPayload>(opts);
+            break;
+        case workload::PayloadKind::unordered_map:
+            run_payload<workload::UnorderedMapPayload>(opts);
+            break;
+        case workload::PayloadKind::string:
+            run_payload<workload::StringPayload>(opts);
+            break;
+        case workload::PayloadKind::structure:
+            run_payload<workload::StructPayload>(opts);
+            break;
+    }
 
     return 0;
 }
@@ -1,10 +1,14 @@
 #!/usr/bin/env python
 import subprocess
 import argparse
+import json
 import shutil
 import os
+import sys
 import multiprocessing
 
+import results
+
 
 def call_command(cmd, cwd=None, env=None):
     """
@@ -45,14 +49,18 @@ def one_measure(
     binary = os.path.join(args.bin_dir, test_bin)
     file_name = '__'.join([test_bin, vec_size, num_all_readers, num_readers,
                            num_writers])
-    file_name = file_name + "." + str(iteration)
+    file_name = file_name + "." + str(iteration) + ".json"
     print(file_name)
     out, err = call_command(
         ['perf', 'stat', '-d', binary, vec_size, num_all_readers, num_readers,
-         num_writers])
+         num_writers, '--json'] + args.workload.split())
+    result = json.loads(out)
+    result['test_bin'] = test_bin
+    result['iteration'] = iteration
+    result['workload'] = args.workload
+    result['perf_stat'] = err
     with open(os.path.join(args.result_dir, file_name), 'w') as f:
-        f.write(out)
-        f.write(err)
+        json.dump(result, f, indent=2)
 
 
 def main():
@@ -61,6 +69,14 @@ def main():
                         required=True)
     parser.add_argument('--result_dir', help='path of result dir',
                         required=True)
+    parser.add_argument('--workload', default='',
+                        help='workload options passed to the test binaries, '
+                        'e.g. "--payload=map --keys=zipf"')
+    parser.add_argument('--baseline_dir', default=None,
+                        help='compare the results with this result set and '
+                        'fail on regressions')
+    parser.add_argument('--threshold', type=float, default=5.0,
+                        help='regression threshold in percent')
     args = parser.parse_args()
 
     if os.path.exists(args.result_dir):
@@ -71,10 +87,22 @@ def main():
         "measure_std_mutex",
         "measure_rcuptr",
         "measure_rcuptr_jss",
+        "measure_rcuptr_intrusive",
+        "measure_rcuptr_distributed",
+        "measure_rcuptr_arena",
+        "measure_rcuptr_huge_pages",
+        "measure_rcuptr_single_writer",
         "measure_tbb_qrw_mutex",
         "measure_tbb_srw_mutex",
+        "measure_left_right",
         "measure_urcu_bp",
     ]
+    # They keep int keys in a hash map and a tree, they are comparable to the
+    # others with the matching payload only.
+    if '--payload=unordered_map' in args.workload.split():
+        test_bins.append("measure_rcu_hash_map")
+    if '--payload=map' in args.workload.split():
+        test_bins.append("measure_rcu_btree")
 
     vec_sizes = ['8196', '131072', '1048576']
     all_readers = ['0', '1']
@@ -102,6 +130,16 @@ def main():
                                 iteration
                             )
 
+    if args.baseline_dir is not None:
+        regressions = results.compare(
+            results.load_measures(args.baseline_dir),
+            results.load_measures(args.result_dir),
+            args.threshold, 0.05)
+        if regressions:
+            print('%d regression(s) beyond %.1f%%' %
+                  (len(regressions), args.threshold))
+            sys.exit(1)
+
 
 if __name__ == "__main__":
     main()
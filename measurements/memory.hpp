@@ -0,0 +1,101 @@
+// memory.hpp
+//
+// Memory footprint statistics of the measurement driver: allocation counts
+// from the interposed allocator (alloc_stats.cpp), the number of live
+// versions of the payload and the peak resident set size.
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <measurements/report.hpp>
+#include <sys/resource.h>
+
+namespace memory {
+
+// Counters of the replaced global operator new/delete. Counting is off by
+// default, so the throughput measurements do not pay for it.
+struct AllocStats {
+    static std::atomic<bool> enabled;
+    static std::atomic<long long> allocations;
+    static std::atomic<long long> deallocations;
+    static std::atomic<long long> allocated_bytes;
+    static std::atomic<long long> live_bytes;
+    static std::atomic<long long> peak_live_bytes;
+};
+
+inline void update_peak(std::atomic<long long>& peak, long long value) {
+    long long current = peak.load(std::memory_order_relaxed);
+    while (current < value &&
+           !peak.compare_exchange_weak(current, value,
+                                       std::memory_order_relaxed)) {
+    }
+}
+
+// Counts the live instances of the type which has it as a member. Every copy
+// made by a writer is a new version, so the count is the number of versions
+// kept alive by readers (plus the current one).
+struct VersionCounter {
+    static std::atomic<long long> live;
+    static std::atomic<long long> peak;
+
+    VersionCounter() { inc(); }
+    VersionCounter(const VersionCounter&) { inc(); }
+    VersionCounter& operator=(const VersionCounter&) { return *this; }
+    ~VersionCounter() { live.fetch_sub(1, std::memory_order_relaxed); }
+
+private:
+    static void inc() {
+        update_peak(peak, live.fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+};
+
+// Payload adaptor which attaches a VersionCounter to the data of Payload.
+template <typename Payload>
+struct Versioned {
+    struct type {
+        typename Payload::type data;
+        VersionCounter counter;
+    };
+    static const char* name() { return Payload::name(); }
+    static type make(std::size_t size) { return {Payload::make(size), {}}; }
+    static int read_one(const type& v, std::size_t key) {
+        return Payload::read_one(v.data, key);
+    }
+    static int read_all(const type& v) { return Payload::read_all(v.data); }
+    static void update_one(type& v, std::size_t key, int value) {
+        Payload::update_one(v.data, key, value);
+    }
+    static void update_all(type& v, int value) {
+        Payload::update_all(v.data, value);
+    }
+};
+
+inline long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+inline void print_stats() {
+    std::cout << "peak rss kb: " << peak_rss_kb() << "\n";
+    std::cout << "allocations: " << AllocStats::allocations.load() << "\n";
+    std::cout << "deallocations: " << AllocStats::deallocations.load()
+              << "\n";
+    std::cout << "allocated bytes: " << AllocStats::allocated_bytes.load()
+              << "\n";
+    std::cout << "peak live bytes: " << AllocStats::peak_live_bytes.load()
+              << "\n";
+    std::cout << "max live versions: " << VersionCounter::peak.load() << "\n";
+}
+
+inline void report(report::JsonObject& json) {
+    json.add("peak_rss_kb", peak_rss_kb());
+    json.add("allocations", AllocStats::allocations.load());
+    json.add("deallocations", AllocStats::deallocations.load());
+    json.add("allocated_bytes", AllocStats::allocated_bytes.load());
+    json.add("peak_live_bytes", AllocStats::peak_live_bytes.load());
+    json.add("max_live_versions", VersionCounter::peak.load());
+}
+
+} // namespace memory
@@ -0,0 +1,152 @@
+// perf_counters.hpp
+//
+// Per thread hardware performance counters via perf_event_open(2). The
+// driver enables them only around the measured loop of each thread, so
+// thread startup and the timer thread are not counted, unlike with
+// `perf stat`.
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace perf {
+
+enum Event { cycles, cache_misses, l1d_read_misses, llc_read_misses, num_events };
+
+inline const char* event_name(int e) {
+    static const char* names[num_events] = {"cycles", "cache_misses",
+                                            "l1d_misses", "llc_misses"};
+    return names[e];
+}
+
+// Sum of the counters of several threads. A counter which could not be opened
+// in any of the threads is invalid. A counter which the kernel time-shared
+// with others (there are more events than hardware counters) was running
+// part of the time only; its value is extrapolated and it is scaled.
+struct Counts {
+    long long values[num_events] = {};
+    bool valid[num_events] = {};
+    bool scaled[num_events] = {};
+    bool any = false; // whether any thread has been added
+
+    Counts& operator+=(const Counts& other) {
+        for (int e = 0; e < num_events; ++e) {
+            values[e] += other.values[e];
+            valid[e] = (any ? valid[e] : true) && other.valid[e];
+            scaled[e] = scaled[e] || other.scaled[e];
+        }
+        any = true;
+        return *this;
+    }
+};
+
+inline perf_event_attr make_attr(int e) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    // The counts are scaled by enabled / running if they were multiplexed.
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // Allows using the counters with perf_event_paranoid == 2.
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    switch (e) {
+        case cycles:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case cache_misses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+            break;
+        case l1d_read_misses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case llc_read_misses:
+        default:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_LL |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+    }
+    return attr;
+}
+
+// The counters of the calling thread. Must be created, started and stopped
+// on the thread which is measured. Counters which can not be opened (no
+// permission, no PMU in a VM, ...) are left out.
+class ThreadCounters {
+    int fds[num_events];
+
+public:
+    ThreadCounters() {
+        for (int e = 0; e < num_events; ++e) {
+            perf_event_attr attr = make_attr(e);
+            fds[e] = static_cast<int>(
+                syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+    }
+    ThreadCounters(const ThreadCounters&) = delete;
+    ThreadCounters& operator=(const ThreadCounters&) = delete;
+    ~ThreadCounters() {
+        for (int fd : fds) {
+            if (fd >= 0) close(fd);
+        }
+    }
+
+    void start() {
+        for (int fd : fds) {
+            if (fd < 0) continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    Counts stop() {
+        Counts counts;
+        counts.any = true;
+        for (int fd : fds) {
+            if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+        for (int e = 0; e < num_events; ++e) {
+            // value, time enabled, time running
+            unsigned long long data[3] = {};
+            counts.valid[e] =
+                fds[e] >= 0 && read(fds[e], data, sizeof(data)) ==
+                                   static_cast<ssize_t>(sizeof(data));
+            // A counter which never ran has no estimate.
+            if (counts.valid[e] && data[2] == 0) counts.valid[e] = false;
+            if (!counts.valid[e]) continue;
+            double value = static_cast<double>(data[0]);
+            if (data[2] < data[1]) {
+                value *= static_cast<double>(data[1]) / data[2];
+                counts.scaled[e] = true;
+            }
+            counts.values[e] = static_cast<long long>(value);
+        }
+        return counts;
+    }
+
+    // Tells why the counters are not available, if they are not.
+    static std::string probe() {
+        perf_event_attr attr = make_attr(cycles);
+        int fd =
+            static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd < 0) return std::strerror(errno);
+        close(fd);
+        return "";
+    }
+};
+
+} // namespace perf
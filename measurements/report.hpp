@@ -0,0 +1,70 @@
+// report.hpp
+//
+// Machine readable (JSON) results of the measurement driver.
+#pragma once
+
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace report {
+
+// A flat JSON object. The values are rendered when they are added, so the
+// object is printed in the order the fields were added.
+class JsonObject {
+    std::vector<std::pair<std::string, std::string>> fields;
+
+    static std::string quote(const std::string& s) {
+        std::string result = "\"";
+        for (char c : s) {
+            if (c == '"' || c == '\\') result += '\\';
+            result += c;
+        }
+        return result + "\"";
+    }
+
+public:
+    void add(const std::string& key, const std::string& value) {
+        fields.emplace_back(key, quote(value));
+    }
+
+    void add(const std::string& key, const char* value) {
+        add(key, std::string(value));
+    }
+
+    void add(const std::string& key, bool value) {
+        fields.emplace_back(key, value ? "true" : "false");
+    }
+
+    template <typename T, typename = std::enable_if_t<std::is_arithmetic<T>{}>>
+    void add(const std::string& key, T value) {
+        std::ostringstream os;
+        os << value;
+        fields.emplace_back(key, os.str());
+    }
+
+    template <typename T>
+    void add(const std::string& key, const std::vector<T>& values) {
+        std::ostringstream os;
+        os << "[";
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            os << (i ? ", " : "") << values[i];
+        }
+        os << "]";
+        fields.emplace_back(key, os.str());
+    }
+
+    void print(std::ostream& os) const {
+        os << "{\n";
+        for (std::size_t i = 0; i < fields.size(); ++i) {
+            os << "  " << quote(fields[i].first) << ": " << fields[i].second
+               << (i + 1 < fields.size() ? ",\n" : "\n");
+        }
+        os << "}\n";
+    }
+};
+
+} // namespace report
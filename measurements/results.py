@@ -0,0 +1,243 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+"""
+Loading of measurement results and comparison of two result sets.
+
+Results are the JSON files written by measure.py. The raw `perf stat` text
+files of older runs are still understood, though they do not have latency
+values.
+
+As a script it compares a result set against a baseline and exits with a
+non-zero status if there is a significant regression beyond the threshold:
+
+    results.py --baseline_dir old --result_dir new --threshold 5
+"""
+from __future__ import print_function
+import argparse
+import json
+import locale
+import math
+import os
+import re
+import sys
+
+
+# Represents one measurement configuration.
+class MeasureKey:
+
+    def __init__(
+            self,
+            test_bin,
+            vec_size,
+            num_all_readers,
+            num_readers,
+            num_writers,
+            workload=''):
+        self.test_bin = test_bin
+        self.num_all_readers = num_all_readers
+        self.vec_size = vec_size
+        self.num_readers = num_readers
+        self.num_writers = num_writers
+        self.workload = workload
+
+    def __str__(self):
+        s = (self.test_bin +
+             " " +
+             str(self.vec_size) +
+             " " +
+             str(self.num_all_readers) +
+             " " +
+             str(self.num_readers) +
+             " " +
+             str(self.num_writers))
+        if self.workload:
+            s += " " + self.workload
+        return s
+
+    def __hash__(self):
+        return self.__str__().__hash__()
+
+    def __eq__(self, other):
+        return self.__str__().__eq__(other.__str__())
+
+
+# We have multiple measurement values for the same configuration (i.e.
+# MeasureKey).
+class MeasureIterations:
+
+    def __init__(self):
+        self.reader_sum = []
+        self.writer_sum = []
+        self.reader_ns_per_op = []
+        self.writer_ns_per_op = []
+
+    def __str__(self):
+        return str(self.reader_sum)
+
+
+# The values we compare, and whether a higher value is better.
+throughput_values = ['reader_sum', 'writer_sum']
+latency_values = ['reader_ns_per_op', 'writer_ns_per_op']
+
+
+def load_json(path, measures):
+    with open(path) as f:
+        result = json.load(f)
+    key = MeasureKey(result['test_bin'], str(result['size']),
+                     str(result['num_all_readers']),
+                     str(result['num_one_readers']),
+                     str(result['num_writers']),
+                     result.get('workload', ''))
+    if key not in measures:
+        measures[key] = MeasureIterations()
+    measureIt = measures[key]
+    for attr in throughput_values + latency_values:
+        if attr in result:
+            getattr(measureIt, attr).append(result[attr])
+
+
+text_patterns = [
+    (re.compile(r"reader sum: ([\d|\.]+)"), 'reader_sum'),
+    (re.compile(r"writer sum: ([\d|\.]+)"), 'writer_sum'),
+]
+
+
+def load_text(path, measures):
+    basename = os.path.splitext(os.path.basename(path))[0]
+    elements = basename.split('__')
+    key = MeasureKey(elements[0], elements[1], elements[2],
+                     elements[3], elements[4])
+    if key not in measures:
+        measures[key] = MeasureIterations()
+    measureIt = measures[key]
+    for line in open(path):
+        for pattern, attr in text_patterns:
+            for match in re.finditer(pattern, line):
+                value = match.groups()[0]
+                locale.setlocale(locale.LC_NUMERIC, '')
+                getattr(measureIt, attr).append(int(locale.atof(value)))
+
+
+# Aggregate the values in each files into a dict, where the key is
+# MeasureKey, and the value is MeasureIterations.
+# We append the found values in each measureIteration to the specific list.
+def load_measures(result_dir):
+    measures = dict()
+    for file in sorted(os.listdir(result_dir)):
+        path = os.path.join(result_dir, file)
+        if file.endswith('.json'):
+            load_json(path, measures)
+        else:
+            load_text(path, measures)
+    return measures
+
+
+def mean(l):
+    return float(sum(l)) / len(l)
+
+
+def variance(l):
+    m = mean(l)
+    return sum((x - m) ** 2 for x in l) / (len(l) - 1)
+
+
+# Continued fraction of the regularized incomplete beta function (Numerical
+# Recipes).
+def betacf(a, b, x):
+    qab, qap, qam = a + b, a + 1.0, a - 1.0
+    c, d = 1.0, 1.0 - qab * x / qap
+    d = 1.0 / (d if abs(d) > 1e-30 else 1e-30)
+    h = d
+    for m in range(1, 200):
+        m2 = 2 * m
+        aa = m * (b - m) * x / ((qam + m2) * (a + m2))
+        d = 1.0 + aa * d
+        d = 1.0 / (d if abs(d) > 1e-30 else 1e-30)
+        c = 1.0 + aa / c
+        c = c if abs(c) > 1e-30 else 1e-30
+        h *= d * c
+        aa = -(a + m) * (qab + m) * x / ((a + m2) * (qap + m2))
+        d = 1.0 + aa * d
+        d = 1.0 / (d if abs(d) > 1e-30 else 1e-30)
+        c = 1.0 + aa / c
+        c = c if abs(c) > 1e-30 else 1e-30
+        delta = d * c
+        h *= delta
+        if abs(delta - 1.0) < 3e-12:
+            break
+    return h
+
+
+def betai(a, b, x):
+    if x <= 0.0:
+        return 0.0
+    if x >= 1.0:
+        return 1.0
+    bt = math.exp(math.lgamma(a + b) - math.lgamma(a) - math.lgamma(b) +
+                  a * math.log(x) + b * math.log(1.0 - x))
+    if x < (a + 1.0) / (a + b + 2.0):
+        return bt * betacf(a, b, x) / a
+    return 1.0 - bt * betacf(b, a, 1.0 - x) / b
+
+
+# Two sided p-value of Welch's t-test, i.e. the probability that the two
+# samples have the same mean.
+def welch_p_value(a, b):
+    if len(a) < 2 or len(b) < 2:
+        return 1.0
+    va, vb = variance(a) / len(a), variance(b) / len(b)
+    if va + vb == 0:
+        return 0.0 if mean(a) != mean(b) else 1.0
+    t = (mean(a) - mean(b)) / math.sqrt(va + vb)
+    df = (va + vb) ** 2 / (va ** 2 / (len(a) - 1) + vb ** 2 / (len(b) - 1))
+    return betai(df / 2.0, 0.5, df / (df + t * t))
+
+
+# Compares the common configurations of two result sets. Returns the list of
+# regressions as (key, value, change in percent, p-value) tuples.
+def compare(baseline, current, threshold, alpha, out=sys.stdout):
+    regressions = []
+    for key in sorted(set(baseline) & set(current), key=str):
+        for attr in throughput_values + latency_values:
+            old = getattr(baseline[key], attr)
+            new = getattr(current[key], attr)
+            if not old or not new or mean(old) == 0:
+                continue
+            change = (mean(new) - mean(old)) / mean(old) * 100.0
+            p = welch_p_value(old, new)
+            worse = -change if attr in throughput_values else change
+            significant = p < alpha
+            status = ''
+            if significant and worse > threshold:
+                status = 'REGRESSION'
+                regressions.append((key, attr, change, p))
+            elif significant and -worse > threshold:
+                status = 'improvement'
+            print('%-60s %-17s %+8.2f%% p=%.4f %s' %
+                  (key, attr, change, p, status), file=out)
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--baseline_dir', help='path of the baseline results',
+                        required=True)
+    parser.add_argument('--result_dir', help='path of the results to check',
+                        required=True)
+    parser.add_argument('--threshold', type=float, default=5.0,
+                        help='regression threshold in percent')
+    parser.add_argument('--alpha', type=float, default=0.05,
+                        help='significance level of the t-test')
+    args = parser.parse_args()
+
+    regressions = compare(load_measures(args.baseline_dir),
+                          load_measures(args.result_dir),
+                          args.threshold, args.alpha)
+    if regressions:
+        print('%d regression(s) beyond %.1f%%' %
+              (len(regressions), args.threshold))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
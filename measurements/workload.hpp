@@ -0,0 +1,396 @@
+// workload.hpp
+//
+// Configurable workload for the measurement driver: payload types, key
+// distributions, read/write mixes and writer burst patterns.
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef TEST_WITH_ARENA_ASP
+#include <detail/arena_allocator.hpp>
+#endif
+#ifdef TEST_WITH_HUGE_PAGE_ASP
+#include <detail/huge_page_allocator.hpp>
+#endif
+
+namespace workload {
+
+// Payloads
+//
+// Each payload describes the data held by an X implementation and the
+// operations the driver performs on it. The X classes only provide the
+// synchronization, so every payload works with every X.
+
+#ifdef TEST_WITH_HUGE_PAGE_ASP
+// Large vectors are placed in huge pages.
+template <typename T>
+using vector_allocator = detail::huge_page_allocator<T>;
+#else
+template <typename T>
+using vector_allocator = std::allocator<T>;
+#endif
+
+struct VectorPayload {
+    using type = std::vector<int, vector_allocator<int>>;
+    static const char* name() { return "vector"; }
+    static type make(std::size_t size) { return type(size, 1); }
+    static int read_one(const type& v, std::size_t key) { return v[key]; }
+    static int read_all(const type& v) {
+        return std::accumulate(v.begin(), v.end(), 0);
+    }
+    static void update_one(type& v, std::size_t key, int value) {
+        v[key] = value;
+    }
+    static void update_all(type& v, int value) {
+        for (auto& e : v) {
+            e = value;
+        }
+    }
+};
+
+template <typename Map>
+struct MapPayloadBase {
+    using type = Map;
+    static type make(std::size_t size) {
+        type m;
+        for (std::size_t i = 0; i < size; ++i) {
+            m.emplace(static_cast<int>(i), 1);
+        }
+        return m;
+    }
+    static int read_one(const type& m, std::size_t key) {
+        auto it = m.find(static_cast<int>(key));
+        return it != m.end() ? it->second : 0;
+    }
+    static int read_all(const type& m) {
+        int sum = 0;
+        for (const auto& e : m) {
+            sum += e.second;
+        }
+        return sum;
+    }
+    static void update_one(type& m, std::size_t key, int value) {
+        m[static_cast<int>(key)] = value;
+    }
+    static void update_all(type& m, int value) {
+        for (auto& e : m) {
+            e.second = value;
+        }
+    }
+};
+
+#ifdef TEST_WITH_ARENA_ASP
+// Each version of a map is placed in its own arena.
+template <typename T>
+using map_allocator = detail::arena::allocator<T>;
+#else
+template <typename T>
+using map_allocator = std::allocator<T>;
+#endif
+
+struct MapPayload
+    : MapPayloadBase<std::map<int, int, std::less<int>,
+                              map_allocator<std::pair<const int, int>>>> {
+    static const char* name() { return "map"; }
+};
+
+struct UnorderedMapPayload
+    : MapPayloadBase<std::unordered_map<
+          int, int, std::hash<int>, std::equal_to<int>,
+          map_allocator<std::pair<const int, int>>>> {
+    static const char* name() { return "unordered_map"; }
+};
+
+struct StringPayload {
+    using type = std::string;
+    static const char* name() { return "string"; }
+    static type make(std::size_t size) { return type(size, 'a'); }
+    static int read_one(const type& s, std::size_t key) { return s[key]; }
+    static int read_all(const type& s) {
+        return std::accumulate(s.begin(), s.end(), 0);
+    }
+    static void update_one(type& s, std::size_t key, int value) {
+        s[key] = static_cast<char>('a' + value % 26);
+    }
+    static void update_all(type& s, int value) {
+        std::fill(s.begin(), s.end(), static_cast<char>('a' + value % 26));
+    }
+};
+
+// A record with nested, separately allocated members, as our production
+// tables have.
+struct Record {
+    int id = 0;
+    double price = 0.0;
+    std::string name;
+    std::vector<int> tags;
+};
+
+struct StructPayload {
+    using type = std::vector<Record>;
+    static const char* name() { return "struct"; }
+    static type make(std::size_t size) {
+        type v(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            v[i].id = static_cast<int>(i);
+            v[i].price = 1.0;
+            v[i].name = "record_" + std::to_string(i);
+            v[i].tags.assign(4, 1);
+        }
+        return v;
+    }
+    static int read_one(const type& v, std::size_t key) {
+        const Record& r = v[key];
+        return r.id + static_cast<int>(r.price) + r.tags.front();
+    }
+    static int read_all(const type& v) {
+        int sum = 0;
+        for (const auto& r : v) {
+            sum += static_cast<int>(r.price) + r.tags.front();
+        }
+        return sum;
+    }
+    static void update_one(type& v, std::size_t key, int value) {
+        Record& r = v[key];
+        r.price = value;
+        r.tags.front() = value;
+    }
+    static void update_all(type& v, int value) {
+        for (auto& r : v) {
+            r.price = value;
+            r.tags.front() = value;
+        }
+    }
+};
+
+// Key distributions
+
+enum class KeyDistribution { round_robin, uniform, zipf };
+
+// Cumulative distribution of a Zipf law over [0, size). It is computed once
+// and shared by the key generators of all threads.
+inline std::shared_ptr<const std::vector<double>> make_zipf_cdf(
+    std::size_t size, double s) {
+    auto cdf = std::make_shared<std::vector<double>>(size);
+    double sum = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+        sum += 1.0 / std::pow(static_cast<double>(i + 1), s);
+        (*cdf)[i] = sum;
+    }
+    for (auto& e : *cdf) {
+        e /= sum;
+    }
+    return cdf;
+}
+
+class KeyGenerator {
+    KeyDistribution dist;
+    std::size_t size;
+    long long i = 0;
+    std::mt19937_64 random_engine{std::random_device{}()};
+    std::uniform_int_distribution<std::size_t> uniform;
+    std::uniform_real_distribution<double> real{0.0, 1.0};
+    std::shared_ptr<const std::vector<double>> zipf_cdf;
+
+public:
+    KeyGenerator(KeyDistribution dist, std::size_t size,
+                 std::shared_ptr<const std::vector<double>> zipf_cdf)
+        : dist(dist), size(size), uniform(0, size - 1),
+          zipf_cdf(std::move(zipf_cdf)) {}
+
+    std::size_t next() {
+        switch (dist) {
+            case KeyDistribution::uniform:
+                return uniform(random_engine);
+            case KeyDistribution::zipf: {
+                auto it = std::lower_bound(zipf_cdf->begin(), zipf_cdf->end(),
+                                           real(random_engine));
+                return std::min<std::size_t>(it - zipf_cdf->begin(), size - 1);
+            }
+            case KeyDistribution::round_robin:
+            default:
+                return i++ % size;
+        }
+    }
+};
+
+// Decides whether the next operation of a mixed thread is a read, so that
+// reads and writes follow the configured ratio.
+class OperationMix {
+    unsigned reads;
+    unsigned writes;
+    unsigned i = 0;
+
+public:
+    OperationMix(unsigned reads, unsigned writes)
+        : reads(reads), writes(writes) {}
+    bool next_is_read() { return i++ % (reads + writes) < reads; }
+};
+
+// Writers perform `burst` updates back to back and then pause. A burst of 0
+// means continuous writing.
+class BurstPacer {
+    unsigned burst;
+    std::chrono::microseconds pause;
+    unsigned i = 0;
+
+public:
+    BurstPacer(unsigned burst, std::chrono::microseconds pause)
+        : burst(burst), pause(pause) {}
+    void after_write() {
+        if (burst == 0 || ++i < burst) return;
+        i = 0;
+        std::this_thread::sleep_for(pause);
+    }
+};
+
+enum class PayloadKind { vector, map, unordered_map, string, structure };
+
+struct Options {
+    std::size_t size = 0;
+    unsigned num_all_readers = 0;
+    unsigned num_one_readers = 0;
+    unsigned num_writers = 0;
+    unsigned num_mixed = 0;
+    unsigned num_holders = 0;
+
+    PayloadKind payload = PayloadKind::vector;
+    KeyDistribution keys = KeyDistribution::round_robin;
+    double zipf_s = 0.99;
+    unsigned mix_reads = 9;
+    unsigned mix_writes = 1;
+    bool write_all = true;
+    unsigned burst = 0;
+    std::chrono::microseconds burst_pause{0};
+    std::chrono::milliseconds duration{1000};
+    std::chrono::microseconds hold{1000};
+    bool memory = false;
+    bool json = false;
+};
+
+inline void print_usage(const char* prog) {
+    std::cerr
+        << "Usage: " << prog
+        << " <size> <num_all_readers> <num_one_readers> <num_writers>"
+           " [options]\n"
+           "  --payload=vector|map|unordered_map|string|struct\n"
+           "  --keys=roundrobin|uniform|zipf  key distribution of single "
+           "element operations\n"
+           "  --zipf=<s>                      Zipf exponent (default 0.99)\n"
+           "  --mixed=<n>                     threads doing a read/write "
+           "mix\n"
+           "  --mix=<reads>:<writes>          ratio of the mixed threads "
+           "(default 9:1)\n"
+           "  --write=all|one                 writers update every or a "
+           "single element\n"
+           "  --burst=<n>                     writes per burst (0: "
+           "continuous)\n"
+           "  --burst-pause-us=<us>           pause between bursts\n"
+           "  --duration-ms=<ms>              length of the measurement\n"
+           "  --holders=<n>                   slow readers which hold a "
+           "snapshot\n"
+           "  --hold-us=<us>                  how long the slow readers "
+           "hold it\n"
+           "  --memory                        report allocations, live "
+           "versions and peak RSS\n"
+           "  --json                          print the results as JSON\n";
+}
+
+// Returns the value of `arg` if it has the form `--name=value`.
+inline const char* option_value(const char* arg, const char* name) {
+    std::size_t len = std::strlen(name);
+    if (std::strncmp(arg, name, len) == 0 && arg[len] == '=') {
+        return arg + len + 1;
+    }
+    return nullptr;
+}
+
+inline bool parse_options(int argc, char** argv, Options& opts) {
+    if (argc < 5) return false;
+    for (int i = 1; i < 5; ++i) {
+        if (argv[i][0] == '-') return false;
+    }
+    opts.size = std::strtoul(argv[1], nullptr, 10);
+    opts.num_all_readers = std::atoi(argv[2]);
+    opts.num_one_readers = std::atoi(argv[3]);
+    opts.num_writers = std::atoi(argv[4]);
+    if (opts.size < 1) return false;
+
+    for (int i = 5; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* v = nullptr;
+        if ((v = option_value(arg, "--payload"))) {
+            std::string p = v;
+            if (p == "vector") {
+                opts.payload = PayloadKind::vector;
+            } else if (p == "map") {
+                opts.payload = PayloadKind::map;
+            } else if (p == "unordered_map") {
+                opts.payload = PayloadKind::unordered_map;
+            } else if (p == "string") {
+                opts.payload = PayloadKind::string;
+            } else if (p == "struct") {
+                opts.payload = PayloadKind::structure;
+            } else {
+                return false;
+            }
+        } else if ((v = option_value(arg, "--keys"))) {
+            std::string k = v;
+            if (k == "roundrobin") {
+                opts.keys = KeyDistribution::round_robin;
+            } else if (k == "uniform") {
+                opts.keys = KeyDistribution::uniform;
+            } else if (k == "zipf") {
+                opts.keys = KeyDistribution::zipf;
+            } else {
+                return false;
+            }
+        } else if ((v = option_value(arg, "--zipf"))) {
+            opts.zipf_s = std::atof(v);
+        } else if ((v = option_value(arg, "--mixed"))) {
+            opts.num_mixed = std::atoi(v);
+        } else if ((v = option_value(arg, "--mix"))) {
+            char* end = nullptr;
+            opts.mix_reads = std::strtoul(v, &end, 10);
+            if (*end != ':') return false;
+            opts.mix_writes = std::strtoul(end + 1, nullptr, 10);
+            if (opts.mix_reads + opts.mix_writes == 0) return false;
+        } else if ((v = option_value(arg, "--write"))) {
+            std::string w = v;
+            if (w != "all" && w != "one") return false;
+            opts.write_all = w == "all";
+        } else if ((v = option_value(arg, "--burst"))) {
+            opts.burst = std::atoi(v);
+        } else if ((v = option_value(arg, "--burst-pause-us"))) {
+            opts.burst_pause = std::chrono::microseconds(std::atol(v));
+        } else if ((v = option_value(arg, "--duration-ms"))) {
+            opts.duration = std::chrono::milliseconds(std::atol(v));
+        } else if ((v = option_value(arg, "--holders"))) {
+            opts.num_holders = std::atoi(v);
+        } else if ((v = option_value(arg, "--hold-us"))) {
+            opts.hold = std::chrono::microseconds(std::atol(v));
+        } else if (std::strcmp(arg, "--memory") == 0) {
+            opts.memory = true;
+        } else if (std::strcmp(arg, "--json") == 0) {
+            opts.json = true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace workload
@@ -0,0 +1,370 @@
+#pragma once
+
+#include <rcu_ptr.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+// Ordered map for read-mostly data: a persistent B+ tree behind an rcu_ptr.
+//
+// Nodes are immutable once they are reachable from the root. An insert or
+// erase copies the nodes on the path from the root to its leaf and shares
+// every other node with the previous version, so it copies
+// O(max_node_size * log n) entries instead of the whole container. The new
+// root is published with copy_update, concurrent writers retry on their own
+// path copy.
+//
+// Readers take a snapshot, which is a consistent version of the whole tree:
+// point lookups and range scans on it take no locks (they are lock-free if
+// the underlying atomic_shared_ptr is) and do not see later updates. Erase
+// removes empty nodes but does not merge underfull ones.
+template <typename K, typename V, typename Compare = std::less<K>,
+          template <typename> class AtomicSharedPtr =
+              detail::__std::atomic_shared_ptr,
+          typename ASPTraits =
+              detail::atomic_shared_ptr_traits<AtomicSharedPtr> >
+class rcu_btree {
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<K, V>;
+    using key_compare = Compare;
+
+    static constexpr std::size_t max_node_size = 32;
+
+private:
+    template <typename T>
+    using shared_ptr = typename ASPTraits::template shared_ptr<T>;
+
+    struct node;
+    using node_ptr = shared_ptr<const node>;
+
+    // A leaf holds the entries, an inner node holds children.size() - 1
+    // separator keys: children[i] holds the keys in [keys[i-1], keys[i]).
+    struct node {
+        bool leaf = true;
+        std::vector<value_type> entries;
+        std::vector<K> keys;
+        std::vector<node_ptr> children;
+
+        bool empty() const { return leaf ? entries.empty() : children.empty(); }
+        std::size_t fill() const { return leaf ? entries.size() : keys.size(); }
+    };
+
+    struct root {
+        node_ptr top;
+        std::size_t size = 0;
+    };
+
+    struct split_result {
+        node_ptr left;
+        node_ptr right; // null if there was no split
+        K separator{};
+    };
+
+    rcu_ptr<root, AtomicSharedPtr, ASPTraits> current;
+    Compare less;
+
+    static shared_ptr<node> copy(const node& n) {
+        return ASPTraits::template make_shared<node>(n);
+    }
+
+    std::size_t child_index(const node& n, const K& key) const {
+        return std::upper_bound(n.keys.begin(), n.keys.end(), key, less) -
+               n.keys.begin();
+    }
+
+    typename std::vector<value_type>::const_iterator entry_lower_bound(
+        const node& n, const K& key) const {
+        return std::lower_bound(
+            n.entries.begin(), n.entries.end(), key,
+            [this](const value_type& e, const K& k) { return less(e.first, k); });
+    }
+
+    bool contains_in(const node& top, const K& key) const {
+        const node* n = &top;
+        while (!n->leaf) {
+            n = n->children[child_index(*n, key)].get();
+        }
+        auto it = entry_lower_bound(*n, key);
+        return it != n->entries.end() && !less(key, it->first);
+    }
+
+    // Splits an overfull node in halves.
+    static split_result split(shared_ptr<node> n) {
+        auto right = ASPTraits::template make_shared<node>();
+        right->leaf = n->leaf;
+        split_result r;
+        if (n->leaf) {
+            std::size_t mid = n->entries.size() / 2;
+            right->entries.assign(n->entries.begin() + mid, n->entries.end());
+            n->entries.erase(n->entries.begin() + mid, n->entries.end());
+            r.separator = right->entries.front().first;
+        } else {
+            std::size_t mid = n->keys.size() / 2;
+            r.separator = n->keys[mid];
+            right->keys.assign(n->keys.begin() + mid + 1, n->keys.end());
+            right->children.assign(n->children.begin() + mid + 1,
+                                   n->children.end());
+            n->keys.erase(n->keys.begin() + mid, n->keys.end());
+            n->children.erase(n->children.begin() + mid + 1,
+                              n->children.end());
+        }
+        r.left = std::move(n);
+        r.right = std::move(right);
+        return r;
+    }
+
+    // Returns the copy of n with the key inserted or assigned.
+    split_result insert(const node& n, const K& key, const V& value,
+                        bool& inserted) const {
+        auto c = copy(n);
+        if (c->leaf) {
+            auto it = c->entries.begin() +
+                      (entry_lower_bound(n, key) - n.entries.begin());
+            if (it != c->entries.end() && !less(key, it->first)) {
+                it->second = value;
+                inserted = false;
+            } else {
+                c->entries.emplace(it, key, value);
+                inserted = true;
+            }
+        } else {
+            std::size_t i = child_index(n, key);
+            split_result r = insert(*n.children[i], key, value, inserted);
+            c->children[i] = std::move(r.left);
+            if (r.right) {
+                c->keys.insert(c->keys.begin() + i, std::move(r.separator));
+                c->children.insert(c->children.begin() + i + 1,
+                                   std::move(r.right));
+            }
+        }
+        if (c->fill() > max_node_size) return split(std::move(c));
+        split_result r;
+        r.left = std::move(c);
+        return r;
+    }
+
+    // Returns the copy of n with the key erased, the key must be present.
+    node_ptr erase(const node& n, const K& key) const {
+        auto c = copy(n);
+        if (c->leaf) {
+            c->entries.erase(c->entries.begin() +
+                             (entry_lower_bound(n, key) - n.entries.begin()));
+        } else {
+            std::size_t i = child_index(n, key);
+            node_ptr child = erase(*n.children[i], key);
+            if (child->empty()) {
+                c->children.erase(c->children.begin() + i);
+                if (!c->keys.empty()) {
+                    c->keys.erase(c->keys.begin() + (i > 0 ? i - 1 : 0));
+                }
+            } else {
+                c->children[i] = std::move(child);
+            }
+        }
+        return c;
+    }
+
+public:
+    class const_iterator;
+
+    // A consistent version of the whole tree.
+    class snapshot {
+        shared_ptr<const root> r;
+        const rcu_btree* tree = nullptr;
+
+        friend class rcu_btree;
+        snapshot(shared_ptr<const root> r, const rcu_btree* tree)
+            : r(std::move(r)), tree(tree) {}
+
+    public:
+        std::size_t size() const { return r->size; }
+        bool empty() const { return r->size == 0; }
+
+        // Returns the value of key or nullptr, it lives as long as the
+        // snapshot.
+        const V* find(const K& key) const {
+            auto it = lower_bound(key);
+            if (it == end() || tree->less(key, it->first)) return nullptr;
+            return &it->second;
+        }
+
+        bool contains(const K& key) const { return find(key) != nullptr; }
+
+        const_iterator begin() const {
+            const_iterator it;
+            it.descend_leftmost(r->top.get());
+            return it;
+        }
+
+        const_iterator end() const { return {}; }
+
+        // The first entry whose key is not less than key.
+        const_iterator lower_bound(const K& key) const {
+            const_iterator it;
+            const node* n = r->top.get();
+            while (!n->leaf) {
+                std::size_t i = tree->child_index(*n, key);
+                it.path.push_back({n, i});
+                n = n->children[i].get();
+            }
+            it.path.push_back(
+                {n, static_cast<std::size_t>(tree->entry_lower_bound(*n, key) -
+                                             n->entries.begin())});
+            it.settle();
+            return it;
+        }
+
+        // Calls f with each entry whose key is in [from, to), in order.
+        template <typename F>
+        void for_each(const K& from, const K& to, F&& f) const {
+            for (auto it = lower_bound(from);
+                 it != end() && tree->less(it->first, to); ++it) {
+                f(*it);
+            }
+        }
+    };
+
+    // Forward iterator over the entries of a snapshot. It must not outlive
+    // the snapshot.
+    class const_iterator {
+        struct position {
+            const node* n;
+            std::size_t i;
+        };
+        // From the root to the current leaf. Empty at the end.
+        std::vector<position> path;
+
+        friend class snapshot;
+
+        void descend_leftmost(const node* n) {
+            while (!n->leaf) {
+                path.push_back({n, 0});
+                n = n->children[0].get();
+            }
+            path.push_back({n, 0});
+            settle();
+        }
+
+        // Moves past the end of exhausted nodes.
+        void settle() {
+            while (!path.empty()) {
+                position& p = path.back();
+                if (p.n->leaf) {
+                    if (p.i < p.n->entries.size()) return;
+                } else if (p.i < p.n->children.size()) {
+                    const node* child = p.n->children[p.i].get();
+                    descend_leftmost(child);
+                    return;
+                }
+                path.pop_back();
+                if (!path.empty()) ++path.back().i;
+            }
+        }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = rcu_btree::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        const_iterator() = default;
+
+        reference operator*() const {
+            return path.back().n->entries[path.back().i];
+        }
+        pointer operator->() const { return &**this; }
+
+        const_iterator& operator++() {
+            ++path.back().i;
+            settle();
+            return *this;
+        }
+        const_iterator operator++(int) {
+            auto old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            if (path.empty() || other.path.empty()) {
+                return path.empty() == other.path.empty();
+            }
+            return path.back().n == other.path.back().n &&
+                   path.back().i == other.path.back().i;
+        }
+        bool operator!=(const const_iterator& other) const {
+            return !(*this == other);
+        }
+    };
+
+    explicit rcu_btree(const Compare& less = Compare()) : less(less) {
+        auto r = ASPTraits::template make_shared<root>();
+        r->top = ASPTraits::template make_shared<node>();
+        current.reset(std::move(r));
+    }
+
+    rcu_btree(const rcu_btree&) = delete;
+    rcu_btree& operator=(const rcu_btree&) = delete;
+
+    snapshot read() const { return {current.read(), this}; }
+
+    bool find(const K& key, V& value) const {
+        auto s = read();
+        if (const V* v = s.find(key)) {
+            value = *v;
+            return true;
+        }
+        return false;
+    }
+
+    bool contains(const K& key) const { return read().contains(key); }
+
+    std::size_t size() const { return current.read()->size; }
+
+    // Returns true if key was inserted, false if it was assigned.
+    bool insert_or_assign(const K& key, const V& value) {
+        bool inserted = false;
+        current.copy_update([&](root* r) {
+            split_result s = insert(*r->top, key, value, inserted);
+            if (s.right) {
+                auto top = ASPTraits::template make_shared<node>();
+                top->leaf = false;
+                top->keys.push_back(std::move(s.separator));
+                top->children.push_back(std::move(s.left));
+                top->children.push_back(std::move(s.right));
+                r->top = std::move(top);
+            } else {
+                r->top = std::move(s.left);
+            }
+            if (inserted) ++r->size;
+        });
+        return inserted;
+    }
+
+    // Returns true if key was erased.
+    bool erase(const K& key) {
+        if (!contains(key)) return false;
+        bool erased = false;
+        current.copy_update([&](root* r) {
+            // It may have been erased since we looked.
+            erased = contains_in(*r->top, key);
+            if (!erased) return;
+            node_ptr top = erase(*r->top, key);
+            // Drop the levels which have a single child.
+            while (!top->leaf && top->children.size() == 1) {
+                node_ptr child = top->children.front();
+                top = std::move(child);
+            }
+            if (top->empty()) top = ASPTraits::template make_shared<node>();
+            r->top = std::move(top);
+            --r->size;
+        });
+        return erased;
+    }
+};
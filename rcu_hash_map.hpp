@@ -0,0 +1,221 @@
+#pragma once
+
+#include <rcu_ptr.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Hash map for read-mostly data built from rcu_ptrs.
+//
+// Each bucket is an immutable vector of entries behind its own rcu_ptr, so a
+// lookup reads the bucket table and one bucket, and an insert or erase
+// copies only the bucket of its key. The bucket table is itself behind an
+// rcu_ptr. When the load factor is exceeded a background thread builds a
+// table with twice as many buckets and publishes it; readers keep using the
+// old table meanwhile, writers wait for the new one.
+//
+// Lookups take no locks, they are lock-free if the underlying
+// atomic_shared_ptr is. Writers of different buckets do not contend.
+template <typename K, typename V, typename Hash = std::hash<K>,
+          typename KeyEqual = std::equal_to<K>,
+          template <typename> class AtomicSharedPtr =
+              detail::__std::atomic_shared_ptr,
+          typename ASPTraits =
+              detail::atomic_shared_ptr_traits<AtomicSharedPtr> >
+class rcu_hash_map {
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<K, V>;
+
+private:
+    using bucket = std::vector<value_type>;
+    using bucket_ptr = rcu_ptr<bucket, AtomicSharedPtr, ASPTraits>;
+
+    struct table {
+        explicit table(std::size_t size)
+            : size(size), buckets(new bucket_ptr[size]) {}
+
+        bucket_ptr& at(std::size_t hash) const { return buckets[hash % size]; }
+
+        const std::size_t size;
+        const std::unique_ptr<bucket_ptr[]> buckets;
+    };
+
+    rcu_ptr<table, AtomicSharedPtr, ASPTraits> current;
+    const Hash hash;
+    const KeyEqual equal;
+    const float max_load_factor = 1.0f;
+    std::atomic<std::size_t> count{0};
+
+    // Writers share it, the resizer owns it while it rehashes.
+    std::shared_timed_mutex writers;
+
+    std::mutex resize_mtx;
+    std::condition_variable resize_cv;
+    bool resize_requested = false;
+    bool stopping = false;
+    std::thread resizer;
+
+    static auto make_bucket(bucket&& b) {
+        return ASPTraits::template make_shared<bucket>(std::move(b));
+    }
+
+    bool overloaded(std::size_t num_buckets) const {
+        return count.load(std::memory_order_relaxed) >
+               max_load_factor * num_buckets;
+    }
+
+    void request_resize() {
+        {
+            std::lock_guard<std::mutex> lock(resize_mtx);
+            resize_requested = true;
+        }
+        resize_cv.notify_one();
+    }
+
+    void resizer_fun() {
+        std::unique_lock<std::mutex> lock(resize_mtx);
+        for (;;) {
+            resize_cv.wait(lock,
+                           [this]() { return resize_requested || stopping; });
+            if (stopping) return;
+            resize_requested = false;
+            lock.unlock();
+            rehash();
+            lock.lock();
+        }
+    }
+
+    void rehash() {
+        std::lock_guard<std::shared_timed_mutex> lock(writers);
+        auto old = current.read();
+        if (!overloaded(old->size)) return;
+        std::size_t size = old->size * 2;
+        while (overloaded(size)) {
+            size *= 2;
+        }
+
+        std::vector<bucket> rehashed(size);
+        for (std::size_t i = 0; i < old->size; ++i) {
+            for (const auto& e : *old->buckets[i].read()) {
+                rehashed[hash(e.first) % size].push_back(e);
+            }
+        }
+        auto t = ASPTraits::template make_shared<table>(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            t->buckets[i].reset(make_bucket(std::move(rehashed[i])));
+        }
+        current.reset(std::move(t));
+    }
+
+public:
+    explicit rcu_hash_map(std::size_t bucket_count = 16,
+                          const Hash& hash = Hash(),
+                          const KeyEqual& equal = KeyEqual())
+        : hash(hash), equal(equal) {
+        if (bucket_count == 0) bucket_count = 1;
+        auto t = ASPTraits::template make_shared<table>(bucket_count);
+        for (std::size_t i = 0; i < bucket_count; ++i) {
+            t->buckets[i].reset(make_bucket(bucket()));
+        }
+        current.reset(std::move(t));
+        resizer = std::thread([this]() { resizer_fun(); });
+    }
+
+    rcu_hash_map(const rcu_hash_map&) = delete;
+    rcu_hash_map& operator=(const rcu_hash_map&) = delete;
+
+    ~rcu_hash_map() {
+        {
+            std::lock_guard<std::mutex> lock(resize_mtx);
+            stopping = true;
+        }
+        resize_cv.notify_one();
+        resizer.join();
+    }
+
+    // Calls `f` with the value of `key`, if there is one. The value is
+    // immutable and stays alive during the call even if it is erased
+    // meanwhile. Returns whether `key` was found.
+    template <typename F>
+    bool visit(const K& key, F&& f) const {
+        auto t = current.read();
+        auto b = t->at(hash(key)).read();
+        for (const auto& e : *b) {
+            if (equal(e.first, key)) {
+                std::forward<F>(f)(e.second);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool find(const K& key, V& value) const {
+        return visit(key, [&value](const V& v) { value = v; });
+    }
+
+    bool contains(const K& key) const {
+        return visit(key, [](const V&) {});
+    }
+
+    // Returns true if `key` was inserted, false if it was assigned.
+    bool insert_or_assign(const K& key, const V& value) {
+        bool inserted = false;
+        std::size_t num_buckets = 0;
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(writers);
+            auto t = current.read();
+            num_buckets = t->size;
+            t->at(hash(key)).copy_update([&](bucket* b) {
+                for (auto& e : *b) {
+                    if (equal(e.first, key)) {
+                        e.second = value;
+                        inserted = false;
+                        return;
+                    }
+                }
+                b->emplace_back(key, value);
+                inserted = true;
+            });
+        }
+        if (inserted) {
+            count.fetch_add(1, std::memory_order_relaxed);
+            if (overloaded(num_buckets)) request_resize();
+        }
+        return inserted;
+    }
+
+    // Returns true if `key` was erased.
+    bool erase(const K& key) {
+        if (!contains(key)) return false;
+        bool erased = false;
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(writers);
+            auto t = current.read();
+            t->at(hash(key)).copy_update([&](bucket* b) {
+                erased = false;
+                for (auto it = b->begin(); it != b->end(); ++it) {
+                    if (equal(it->first, key)) {
+                        b->erase(it);
+                        erased = true;
+                        return;
+                    }
+                }
+            });
+        }
+        if (erased) count.fetch_sub(1, std::memory_order_relaxed);
+        return erased;
+    }
+
+    std::size_t size() const { return count.load(std::memory_order_relaxed); }
+
+    std::size_t bucket_count() const { return current.read()->size; }
+};
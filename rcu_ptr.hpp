@@ -2,19 +2,30 @@
 
 #include <detail/atomic_shared_ptr_traits.hpp>
 #include <detail/atomic_shared_ptr.hpp>
+#include <detail/deep_copy.hpp>
+#include <detail/parallel_copy.hpp>
+#include <detail/write_policy.hpp>
 #include <memory>
 #include <atomic>
 
 template <typename T, template <typename> class AtomicSharedPtr =
                           detail::__std::atomic_shared_ptr,
           typename ASPTraits =
-              detail::atomic_shared_ptr_traits<AtomicSharedPtr> >
-class rcu_ptr {
+              detail::atomic_shared_ptr_traits<AtomicSharedPtr>,
+          typename WritePolicy = detail::multi_writer>
+class rcu_ptr : private WritePolicy::template writer<
+                    typename ASPTraits::template shared_ptr<T> > {
 
     template <typename _T>
     using atomic_shared_ptr =
         typename ASPTraits::template atomic_shared_ptr<_T>;
 
+    // A base, so that the state-less multi_writer takes no space. It is
+    // initialized from desired before asp takes it.
+    using writer_type = typename WritePolicy::template writer<
+        typename ASPTraits::template shared_ptr<T> >;
+    writer_type& writer() { return *this; }
+
     atomic_shared_ptr<T> asp;
 
 public:
@@ -26,11 +37,13 @@ public:
     // template <typename Y>
     // rcu_ptr(const std::shared_ptr<Y>& r) {}
 
-    rcu_ptr() = default;
+    rcu_ptr() : writer_type(shared_ptr<T>()) {}
 
-    rcu_ptr(const shared_ptr<T>& desired) : asp(desired) {}
+    rcu_ptr(const shared_ptr<T>& desired)
+        : writer_type(desired), asp(desired) {}
 
-    rcu_ptr(shared_ptr<T>&& desired) : asp(std::move(desired)) {}
+    rcu_ptr(shared_ptr<T>&& desired)
+        : writer_type(desired), asp(std::move(desired)) {}
 
     rcu_ptr(const rcu_ptr&) = delete;
     rcu_ptr& operator=(const rcu_ptr&) = delete;
@@ -49,11 +62,13 @@ public:
     // We can use it to reset the wrapped data to a new value independent from
     // the old value. ( e.g. vector.clear() )
     void reset(const shared_ptr<T>& r) {
-        asp.store(r, std::memory_order_release);
+        auto guard = writer().enter();
+        writer().store(asp, r);
     }
 
     void reset(shared_ptr<T>&& r) {
-        asp.store(std::move(r), std::memory_order_release);
+        auto guard = writer().enter();
+        writer().store(asp, std::move(r));
     }
 
     // Updates the content of the wrapped shared_ptr.
@@ -66,21 +81,86 @@ public:
     //
     // A call expression with this function is invalid,
     // if T is a non-copyable type.
+    //
+    // With the detail::single_writer policy, fun is called exactly once,
+    // and it must not write this rcu_ptr itself, see detail::single_writer.
     template <typename R>
     void copy_update(R&& fun) {
-        shared_ptr<T> sp_l = asp.load(std::memory_order_consume);
+        auto guard = writer().enter();
+        decltype(auto) sp_l = writer().load(asp);
         shared_ptr<T> r;
         do {
             if (sp_l) {
                 // deep copy
-                r = ASPTraits::template make_shared<T>(*sp_l);
+                r = detail::deep_copy<ASPTraits>(*sp_l);
             }
 
             // update
             std::forward<R>(fun)(r.get());
-        } while (!asp.compare_exchange_strong(sp_l, std::move(r),
-                                              std::memory_order_release,
-                                              std::memory_order_consume));
+        } while (!writer().publish(asp, sp_l, std::move(r)));
+    }
+
+    // Like copy_update, but a large copy is split into chunks which are
+    // copied on the threads of executor, before fun is called. E.g. pass a
+    // detail::tbb_executor (detail/tbb_executor.hpp) to copy on the TBB
+    // worker threads. See detail/parallel_copy.hpp for the types whose copy
+    // is split.
+    template <typename R, typename Executor = detail::thread_executor>
+    void parallel_copy_update(R&& fun, Executor&& executor = Executor()) {
+        auto guard = writer().enter();
+        decltype(auto) sp_l = writer().load(asp);
+        shared_ptr<T> r;
+        do {
+            if (sp_l) {
+                r = detail::parallel_copy<ASPTraits>(*sp_l, executor);
+            }
+            std::forward<R>(fun)(r.get());
+        } while (!writer().publish(asp, sp_l, std::move(r)));
+    }
+
+    // Like copy_update, but when another writer has published since the
+    // copy was made, the copy is reconciled with that version by
+    //   bool merge(const T& base, T& mine, const T& theirs)
+    // instead of making a new copy and calling fun again. base is the
+    // version the copy was made from, mine the updated copy and theirs the
+    // version which has been published meanwhile. merge adds the changes
+    // from base to theirs to mine, and returns false if they conflict with
+    // the update, then copy_update starts over. merge may be called
+    // several times, with the previous theirs as base. See
+    // detail/merge.hpp for merges of writers which declare what they touch.
+    //
+    // If the rcu_ptr is empty, fun is called with nullptr and merge is not
+    // called.
+    template <typename R, typename M>
+    void copy_update_merge(R&& fun, M&& merge) {
+        auto guard = writer().enter();
+        decltype(auto) sp_l = writer().load(asp);
+        shared_ptr<T> base;
+        shared_ptr<T> r;
+        bool start_over = true;
+        for (;;) {
+            if (start_over) {
+                base = sp_l;
+                r = shared_ptr<T>();
+                if (sp_l) r = detail::deep_copy<ASPTraits>(*sp_l);
+                std::forward<R>(fun)(r.get());
+            }
+            // The CAS consumes the desired pointer, r is kept for a merge.
+            shared_ptr<T> desired = r;
+            if (writer().publish(asp, sp_l, std::move(desired))) return;
+            start_over = !base || !r || !sp_l ||
+                         !merge(static_cast<const T&>(*base), *r,
+                                static_cast<const T&>(*sp_l));
+            if (!start_over) base = sp_l;
+        }
     }
 };
 
+// An rcu_ptr with the default atomic shared_ptr which is written by one
+// thread at a time, see detail::single_writer.
+template <typename T>
+using single_writer_rcu_ptr =
+    rcu_ptr<T, detail::__std::atomic_shared_ptr,
+            detail::atomic_shared_ptr_traits<detail::__std::atomic_shared_ptr>,
+            detail::single_writer>;
+
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <detail/shm_segment.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+// An rcu_ptr whose versions live in a POSIX shared memory segment, so that
+// one writer process serves snapshots to many reader processes on the same
+// host without copies (Linux only).
+//
+// The writer creates the named segment and allocates every version from the
+// pages of the segment, each version with its own arena, which is freed at
+// once when the version is reclaimed. Values must not hold ordinary
+// pointers: they are mapped at different addresses in different processes.
+// They point into their version with detail::shm::offset_ptr, e.g. through
+// shm_array.
+//
+// A reader process opens the segment by name and claims a reader slot. A
+// snapshot pins the version it reads in the slot, like a hazard pointer.
+// After every publication the writer frees the retired versions which no
+// slot pins. A slot whose process has exited without releasing it (e.g. it
+// crashed) is cleared by the writer, so a crashed reader does not keep its
+// version forever. The process ids must be of the writer's pid namespace.
+
+// Allocates from the arena of the version which is being built. It is
+// process local: values must not store it.
+template <typename U>
+using shm_allocator = detail::shm::allocator<U>;
+
+// An array of trivially copyable values in the version of a shm_rcu_ptr.
+// It is not copyable on its own, a copy is made with the allocator of the
+// version it belongs to.
+template <typename U>
+class shm_array {
+    static_assert(std::is_trivially_copyable<U>::value,
+                  "values are copied bytewise, they must be trivially "
+                  "copyable");
+
+    std::size_t count = 0;
+    detail::shm::offset_ptr<U> items;
+
+public:
+    using value_type = U;
+    using allocator_type = shm_allocator<U>;
+
+    shm_array() = default;
+
+    shm_array(std::allocator_arg_t, allocator_type alloc, std::size_t n,
+              const U& value = U())
+        : count(n), items(n > 0 ? alloc.allocate(n) : nullptr) {
+        std::fill_n(items.get(), n, value);
+    }
+
+    shm_array(std::allocator_arg_t, allocator_type alloc,
+              const shm_array& other)
+        : count(other.count),
+          items(other.count > 0 ? alloc.allocate(other.count) : nullptr) {
+        if (count > 0) {
+            std::memcpy(items.get(), other.data(), count * sizeof(U));
+        }
+    }
+
+    shm_array(const shm_array&) = delete;
+    shm_array& operator=(const shm_array&) = delete;
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    U* data() { return items.get(); }
+    const U* data() const { return items.get(); }
+    U& operator[](std::size_t i) { return items[i]; }
+    const U& operator[](std::size_t i) const { return items[i]; }
+    U* begin() { return data(); }
+    U* end() { return data() + count; }
+    const U* begin() const { return data(); }
+    const U* end() const { return data() + count; }
+};
+
+template <typename T>
+class shm_rcu_ptr {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "versions are freed without running destructors");
+
+public:
+    using element_type = T;
+    using allocator_type = shm_allocator<char>;
+
+    class snapshot;
+    class reader;
+
+    // Creates the segment name of size bytes with max_readers reader slots.
+    // There is no version until the first emplace. Throws std::system_error
+    // if it can not be created, e.g. because it exists already.
+    shm_rcu_ptr(const std::string& name, std::size_t size,
+                std::size_t max_readers = 64)
+        : seg(detail::shm::create_t(), name, size, max_readers, sizeof(T)) {}
+
+    shm_rcu_ptr(const shm_rcu_ptr&) = delete;
+    shm_rcu_ptr& operator=(const shm_rcu_ptr&) = delete;
+
+    // Removes the name of the segment. Processes which have mapped it keep
+    // it until they unmap it.
+    static void remove(const std::string& name) {
+        detail::shm::segment::remove(name);
+    }
+
+    // The current version, for the writer.
+    const T* get() const {
+        return value_of(seg,
+                        seg.head().current.load(std::memory_order_relaxed));
+    }
+
+    // Publishes a new version constructed from args, with the allocator of
+    // the version as leading arguments if T uses it. Throws std::bad_alloc
+    // if the segment is full.
+    template <typename... Args>
+    void emplace(Args&&... args) {
+        detail::shm::arena a(seg);
+        try {
+            construct(a, std::forward<Args>(args)...);
+        } catch (...) {
+            detail::shm::free_version(seg, a.version());
+            throw;
+        }
+        publish(a.version());
+    }
+
+    // Like rcu_ptr::copy_update, fun(T*, allocator_type&) modifies a copy of
+    // the current version, which is published afterwards. Allocations for
+    // the copy must be made with the allocator. If there is no version, fun
+    // is called with nullptr and nothing is published.
+    template <typename R>
+    void copy_update(R&& fun) {
+        std::uint64_t current =
+            seg.head().current.load(std::memory_order_relaxed);
+        detail::shm::arena a(seg);
+        try {
+            T* copy = current ? construct(a, *value_of(seg, current)) : nullptr;
+            allocator_type alloc(&a);
+            std::forward<R>(fun)(copy, alloc);
+            if (!copy) {
+                detail::shm::free_version(seg, a.version());
+                return;
+            }
+        } catch (...) {
+            detail::shm::free_version(seg, a.version());
+            throw;
+        }
+        publish(a.version());
+    }
+
+    // Frees the retired versions which no reader pins, after clearing the
+    // slots of readers which have exited. It is called after every
+    // publication. Returns the number of versions which remain retired.
+    std::size_t reclaim() {
+        std::vector<std::uint64_t> pinned;
+        for (std::size_t i = 0; i < seg.max_readers(); ++i) {
+            detail::shm::reader_slot& s = seg.slot(i);
+            std::int32_t pid = s.pid.load(std::memory_order_acquire);
+            if (pid == 0) continue;
+            if (!detail::shm::process_alive(pid)) {
+                s.pinned.store(0, std::memory_order_relaxed);
+                s.pid.store(0, std::memory_order_release);
+                continue;
+            }
+            pinned.push_back(s.pinned.load(std::memory_order_seq_cst));
+        }
+        auto keep = std::remove_if(
+            retired_versions.begin(), retired_versions.end(),
+            [&](std::uint64_t v) {
+                if (std::find(pinned.begin(), pinned.end(), v) !=
+                    pinned.end()) {
+                    return false;
+                }
+                detail::shm::free_version(seg, v);
+                return true;
+            });
+        retired_versions.erase(keep, retired_versions.end());
+        return retired_versions.size();
+    }
+
+    // The number of versions which are replaced but not freed yet.
+    std::size_t retired() const { return retired_versions.size(); }
+
+    // The number of pages of the segment which hold versions.
+    std::size_t used_pages() const { return seg.used_pages(); }
+
+private:
+    static const T* value_of(const detail::shm::segment& seg,
+                             std::uint64_t version) {
+        if (version == 0) return nullptr;
+        return seg.at<T>(seg.at<detail::shm::chunk>(version)->value);
+    }
+
+    template <typename... Args>
+    T* construct(detail::shm::arena& a, Args&&... args) {
+        void* p = a.allocate(sizeof(T), alignof(T));
+        T* value = construct(p, allocator_type(&a),
+                             std::uses_allocator<T, allocator_type>(),
+                             std::forward<Args>(args)...);
+        a.set_value(value);
+        return value;
+    }
+
+    template <typename... Args>
+    static T* construct(void* p, const allocator_type& alloc, std::true_type,
+                        Args&&... args) {
+        return new (p)
+            T(std::allocator_arg, alloc, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    static T* construct(void* p, const allocator_type&, std::false_type,
+                        Args&&... args) {
+        return new (p) T(std::forward<Args>(args)...);
+    }
+
+    void publish(std::uint64_t version) {
+        std::uint64_t old = seg.head().current.exchange(
+            version, std::memory_order_seq_cst);
+        if (old != 0) retired_versions.push_back(old);
+        reclaim();
+    }
+
+    detail::shm::segment seg;
+    // Writer local, the versions of a writer which exits are not freed.
+    std::vector<std::uint64_t> retired_versions;
+};
+
+// A version pinned by a reader. It must not outlive its reader.
+template <typename T>
+class shm_rcu_ptr<T>::snapshot {
+    detail::shm::reader_slot* slot;
+    const T* value;
+
+    friend class reader;
+    snapshot(detail::shm::reader_slot* slot, const T* value)
+        : slot(slot), value(value) {}
+
+public:
+    snapshot(snapshot&& other) : slot(other.slot), value(other.value) {
+        other.slot = nullptr;
+    }
+    snapshot(const snapshot&) = delete;
+    snapshot& operator=(const snapshot&) = delete;
+    snapshot& operator=(snapshot&&) = delete;
+
+    ~snapshot() {
+        if (slot) slot->pinned.store(0, std::memory_order_release);
+    }
+
+    const T* get() const { return value; }
+    const T& operator*() const { return *value; }
+    const T* operator->() const { return value; }
+    explicit operator bool() const { return value != nullptr; }
+};
+
+// Reads the versions of a shm_rcu_ptr from any process. A reader pins one
+// version at a time: a snapshot must be destroyed before the next read. It
+// is used by one thread at a time.
+template <typename T>
+class shm_rcu_ptr<T>::reader {
+    detail::shm::segment seg;
+    detail::shm::reader_slot* slot = nullptr;
+
+public:
+    // Opens the segment name and claims a reader slot. Throws
+    // std::system_error if it can not be opened, and std::runtime_error if
+    // it is not a segment of T or all slots are taken.
+    explicit reader(const std::string& name) : seg(name, sizeof(T)) {
+        std::int32_t pid = static_cast<std::int32_t>(::getpid());
+        for (std::size_t i = 0; i < seg.max_readers(); ++i) {
+            std::int32_t expected = 0;
+            if (seg.slot(i).pid.compare_exchange_strong(expected, pid)) {
+                slot = &seg.slot(i);
+                return;
+            }
+        }
+        throw std::runtime_error(name + ": no free reader slot");
+    }
+
+    reader(const reader&) = delete;
+    reader& operator=(const reader&) = delete;
+
+    ~reader() {
+        slot->pinned.store(0, std::memory_order_release);
+        slot->pid.store(0, std::memory_order_release);
+    }
+
+    snapshot read() {
+        assert(slot->pinned.load(std::memory_order_relaxed) == 0 &&
+               "the previous snapshot of the reader is alive");
+        const auto& current = seg.head().current;
+        std::uint64_t v = current.load(std::memory_order_acquire);
+        for (;;) {
+            // Pin it and check that it was not replaced meanwhile, then the
+            // writer sees the pin before it could free it.
+            slot->pinned.store(v, std::memory_order_seq_cst);
+            std::uint64_t again = current.load(std::memory_order_seq_cst);
+            if (again == v) break;
+            v = again;
+        }
+        return snapshot(slot, value_of(seg, v));
+    }
+};
@@ -0,0 +1,131 @@
+// arena_asp_core.cpp
+//
+#include <detail/arena_atomic_shared_ptr_traits.hpp>
+#include <tests/rcu_ptr_under_test.hpp>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace detail::arena;
+
+namespace {
+
+using traits = atomic_shared_ptr_traits<detail::__std::atomic_shared_ptr>;
+using Map = std::map<int, int, std::less<int>,
+                     allocator<std::pair<const int, int> > >;
+
+Map make_map(int size) {
+    Map m;
+    for (int i = 0; i < size; ++i) {
+        m.emplace(i, i);
+    }
+    return m;
+}
+
+// Allocator-aware type which counts its live instances.
+struct Counted {
+    using allocator_type = allocator<int>;
+    static std::atomic<int> live;
+    std::vector<int, allocator_type> values;
+    explicit Counted(const allocator_type& alloc) : values(alloc) { ++live; }
+    Counted(const Counted& other, const allocator_type& alloc)
+        : values(other.values, alloc) {
+        ++live;
+    }
+    ~Counted() { --live; }
+};
+std::atomic<int> Counted::live{0};
+
+} // namespace
+
+struct ArenaAtomicSharedPtrCore : public ::testing::Test {
+    void TearDown() override { ASSERT_EQ(0, Counted::live); }
+};
+
+TEST_F(ArenaAtomicSharedPtrCore, monotonic_arena_aligns_and_grows) {
+    monotonic_arena a(256);
+    void* p1 = a.allocate(1, 1);
+    void* p2 = a.allocate(8, 64);
+    ASSERT_EQ(0u, reinterpret_cast<std::uintptr_t>(p2) % 64);
+    ASSERT_NE(p1, p2);
+    void* big = a.allocate(10000, 16);
+    ASSERT_NE(nullptr, big);
+    ASSERT_LE(10009u, a.used());
+}
+
+TEST_F(ArenaAtomicSharedPtrCore, allocator_without_arena_uses_the_heap) {
+    std::vector<int, allocator<int> > v(100, 1);
+    ASSERT_EQ(nullptr, v.get_allocator().arena());
+    ASSERT_EQ(100u, v.size());
+}
+
+TEST_F(ArenaAtomicSharedPtrCore, make_shared_places_the_value_in_an_arena) {
+    auto sp = traits::make_shared<Map>(make_map(1000));
+    monotonic_arena* a = sp->get_allocator().arena();
+    ASSERT_NE(nullptr, a);
+    ASSERT_EQ(make_map(1000), *sp);
+
+    auto copy = traits::make_shared<Map>(*sp);
+    ASSERT_NE(nullptr, copy->get_allocator().arena());
+    ASSERT_NE(a, copy->get_allocator().arena());
+    ASSERT_EQ(*sp, *copy);
+    // The copy is sized after the original, so it needs no more chunks.
+    ASSERT_EQ(a->used(), copy->get_allocator().arena()->used());
+}
+
+TEST_F(ArenaAtomicSharedPtrCore, copy_construction_leaves_the_arena) {
+    auto sp = traits::make_shared<Map>(make_map(10));
+    Map copy(*sp);
+    ASSERT_EQ(nullptr, copy.get_allocator().arena());
+}
+
+TEST_F(ArenaAtomicSharedPtrCore, other_types_use_make_shared) {
+    auto sp = traits::make_shared<int>(42);
+    ASSERT_EQ(42, *sp);
+    auto v = traits::make_shared<std::vector<int> >(3, 1);
+    ASSERT_EQ(3u, v->size());
+}
+
+TEST_F(ArenaAtomicSharedPtrCore, version_is_destroyed_with_its_arena) {
+    {
+        auto sp = traits::make_shared<Counted>();
+        sp->values.push_back(1);
+        auto copy = traits::make_shared<Counted>(*sp);
+        ASSERT_EQ(2, Counted::live);
+        ASSERT_EQ(sp->values, copy->values);
+    }
+    ASSERT_EQ(0, Counted::live);
+}
+
+TEST_F(ArenaAtomicSharedPtrCore, rcu_ptr_copy_update) {
+    rcu_ptr<Map, detail::__std::atomic_shared_ptr, traits> p(
+        traits::make_shared<Map>(make_map(100)));
+    auto first = p.read();
+
+    std::thread t1{[&p]() {
+        for (int i = 0; i < 1000; ++i) {
+            p.copy_update([i](Map* m) { (*m)[i % 100] += 1; });
+        }
+    }};
+    std::thread t2{[&p]() {
+        for (int i = 0; i < 1000; ++i) {
+            p.copy_update([i](Map* m) { m->emplace(1000 + i, i); });
+        }
+    }};
+    t1.join();
+    t2.join();
+
+    auto last = p.read();
+    ASSERT_EQ(1100u, last->size());
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_EQ(i + 10, last->at(i));
+    }
+    ASSERT_NE(first->get_allocator().arena(),
+              last->get_allocator().arena());
+    ASSERT_EQ(make_map(100), *first);
+}
@@ -0,0 +1,157 @@
+#include <bounded_rcu_ptr.hpp>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using V = std::vector<int>;
+using bounded = bounded_rcu_ptr<V>;
+
+bounded::limits two_versions(overflow_policy policy) {
+    bounded::limits l;
+    l.max_versions = 2;
+    l.policy = policy;
+    return l;
+}
+
+void push(bounded& b, int x) {
+    b.copy_update([x](V* v) { v->push_back(x); });
+}
+
+} // namespace
+
+TEST(BoundedRcuPtrTest, counts_live_versions) {
+    bounded b(two_versions(overflow_policy::fail), std::make_shared<V>());
+    ASSERT_EQ(1u, b.live_versions());
+    push(b, 1);
+    push(b, 2);
+    ASSERT_EQ(1u, b.live_versions());
+    {
+        auto s = b.read();
+        push(b, 3);
+        ASSERT_EQ(2u, b.live_versions());
+        ASSERT_EQ(V({1, 2}), *s);
+    }
+    ASSERT_EQ(1u, b.live_versions());
+    ASSERT_EQ(V({1, 2, 3}), *b.read());
+}
+
+TEST(BoundedRcuPtrTest, fail_throws_when_readers_hold_versions) {
+    bounded b(two_versions(overflow_policy::fail), std::make_shared<V>());
+    auto s = b.read();
+    push(b, 1);
+    ASSERT_THROW(push(b, 2), version_limit_error);
+    ASSERT_EQ(V({1}), *b.read());
+    ASSERT_EQ(2u, b.live_versions());
+}
+
+TEST(BoundedRcuPtrTest, block_waits_for_readers) {
+    bounded b(two_versions(overflow_policy::block), std::make_shared<V>());
+    auto s = std::make_unique<bounded::snapshot>(b.read());
+    push(b, 1);
+    std::atomic<bool> done{false};
+    std::thread writer([&]() {
+        push(b, 2);
+        done = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ASSERT_FALSE(done);
+    s.reset();
+    writer.join();
+    ASSERT_TRUE(done);
+    ASSERT_EQ(V({1, 2}), *b.read());
+}
+
+TEST(BoundedRcuPtrTest, coalesce_defers_updates) {
+    bounded b(two_versions(overflow_policy::coalesce), std::make_shared<V>());
+    {
+        auto s = b.read();
+        push(b, 1);
+        ASSERT_FALSE(b.copy_update([](V* v) { v->push_back(2); }));
+        ASSERT_FALSE(b.copy_update([](V* v) { v->push_back(3); }));
+        ASSERT_EQ(2u, b.pending_updates());
+        ASSERT_EQ(V({1}), *b.read());
+    }
+    ASSERT_TRUE(b.copy_update([](V* v) { v->push_back(4); }));
+    ASSERT_EQ(0u, b.pending_updates());
+    ASSERT_EQ(V({1, 2, 3, 4}), *b.read());
+}
+
+TEST(BoundedRcuPtrTest, flush_publishes_deferred_updates) {
+    bounded b(two_versions(overflow_policy::coalesce), std::make_shared<V>());
+    {
+        auto s = b.read();
+        push(b, 1);
+        push(b, 2);
+    }
+    ASSERT_TRUE(b.flush());
+    ASSERT_FALSE(b.flush());
+    ASSERT_EQ(V({1, 2}), *b.read());
+}
+
+TEST(BoundedRcuPtrTest, limits_live_bytes) {
+    bounded::limits l;
+    l.max_bytes = 2000;
+    l.policy = overflow_policy::fail;
+    l.size_of = [](const V& v) { return v.size() * sizeof(int); };
+    bounded b(l, std::make_shared<V>(200, 0));
+    ASSERT_EQ(800u, b.live_bytes());
+    push(b, 1);
+    ASSERT_EQ(804u, b.live_bytes());
+    auto s = b.read();
+    push(b, 2);
+    ASSERT_EQ(1612u, b.live_bytes());
+    ASSERT_THROW(push(b, 3), version_limit_error);
+    ASSERT_EQ(1612u, b.live_bytes());
+    ASSERT_EQ(2u, b.live_versions());
+}
+
+TEST(BoundedRcuPtrTest, failed_publish_releases_its_version) {
+    bool size_fails = false;
+    bounded::limits l = two_versions(overflow_policy::fail);
+    l.size_of = [&size_fails](const V& v) {
+        if (size_fails) throw std::runtime_error("size_of");
+        return v.size();
+    };
+    bounded b(l, std::make_shared<V>());
+    auto fails = [&size_fails](V* v) {
+        v->push_back(1);
+        size_fails = true;
+    };
+    ASSERT_THROW(b.copy_update(fails), std::runtime_error);
+    ASSERT_EQ(1u, b.live_versions());
+    size_fails = false;
+    push(b, 2);
+    ASSERT_EQ(V({2}), *b.read());
+}
+
+TEST(BoundedRcuPtrTest, takes_move_only_updates) {
+    auto update = [](int x) {
+        return [p = std::make_unique<int>(x)](V* v) { v->push_back(*p); };
+    };
+    bounded f(two_versions(overflow_policy::fail), std::make_shared<V>());
+    ASSERT_TRUE(f.copy_update(update(1)));
+    ASSERT_EQ(V({1}), *f.read());
+
+    bounded c(two_versions(overflow_policy::coalesce), std::make_shared<V>());
+    {
+        auto s = c.read();
+        ASSERT_TRUE(c.copy_update(update(1)));
+        ASSERT_FALSE(c.copy_update(update(2)));
+    }
+    ASSERT_TRUE(c.flush());
+    ASSERT_EQ(V({1, 2}), *c.read());
+}
+
+TEST(BoundedRcuPtrTest, rejects_less_than_two_versions) {
+    bounded::limits l;
+    l.max_versions = 1;
+    ASSERT_THROW(bounded b(l), std::invalid_argument);
+}
@@ -0,0 +1,124 @@
+#include <checkpoint.hpp>
+#include <tests/rcu_ptr_under_test.hpp>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace {
+
+using V = std::vector<int>;
+
+void serialize(const V& v, checkpoint_writer& w) {
+    w.write_value(v.size());
+    w.write(v.data(), v.size() * sizeof(int));
+}
+
+V load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::size_t size = 0;
+    in.read(reinterpret_cast<char*>(&size), sizeof(size));
+    V v(size);
+    in.read(reinterpret_cast<char*>(v.data()), size * sizeof(int));
+    return v;
+}
+
+std::size_t file_size(const std::string& path) {
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    return static_cast<std::size_t>(in.tellg());
+}
+
+struct CheckpointTest : public ::testing::Test {
+    std::string dir;
+    std::string path;
+
+    void SetUp() override {
+        char tmpl[] = "/tmp/checkpoint_test.XXXXXX";
+        ASSERT_NE(nullptr, ::mkdtemp(tmpl));
+        dir = tmpl;
+        path = dir + "/checkpoint";
+    }
+    void TearDown() override {
+        std::remove(path.c_str());
+        ::rmdir(dir.c_str());
+    }
+};
+
+} // namespace
+
+TEST_F(CheckpointTest, write_checkpoint_buffered_and_direct) {
+    V v(100000);
+    for (std::size_t i = 0; i < v.size(); ++i) {
+        v[i] = static_cast<int>(i);
+    }
+    for (bool direct : {false, true}) {
+        checkpoint_options options;
+        options.direct_io = direct;
+        options.buffer_size = 10000; // not a multiple of the block size
+        auto stats = write_checkpoint(v, path, serialize, options);
+        std::size_t expected = sizeof(std::size_t) + v.size() * sizeof(int);
+        ASSERT_EQ(expected, stats.bytes);
+        ASSERT_EQ(expected, file_size(path));
+        ASSERT_EQ(v, load(path));
+        ASSERT_LT(0, stats.throughput());
+    }
+}
+
+TEST_F(CheckpointTest, failing_serializer_leaves_no_file) {
+    ASSERT_THROW(write_checkpoint(V(10), path,
+                                  [](const V&, checkpoint_writer&) {
+                                      throw std::runtime_error("failed");
+                                  }),
+                 std::runtime_error);
+    ASSERT_FALSE(std::ifstream(path).good());
+    ASSERT_FALSE(std::ifstream(path + ".tmp").good());
+}
+
+TEST_F(CheckpointTest, checkpoint_error_is_rethrown_by_wait) {
+    rcu_ptr_under_test<V> p(asp_traits::make_shared<V>(10));
+    checkpointer<V> c(p, serialize);
+    ASSERT_TRUE(c.start(dir + "/missing/checkpoint"));
+    ASSERT_THROW(c.wait(), std::system_error);
+}
+
+// Writers keep updating while the checkpoint runs, it holds the version
+// which was current at start.
+TEST_F(CheckpointTest, checkpoint_while_writers_update) {
+    rcu_ptr_under_test<V> p(asp_traits::make_shared<V>(1000000, 0));
+    std::atomic<bool> stop{false};
+    std::atomic<int> updates{0};
+    std::thread writer{[&]() {
+        while (!stop.load()) {
+            p.copy_update([](V* v) {
+                for (auto& e : *v) {
+                    ++e;
+                }
+            });
+            ++updates;
+        }
+    }};
+
+    checkpointer<V> c(p, serialize);
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_TRUE(c.start(path));
+        auto stats = c.wait();
+        ASSERT_EQ(sizeof(std::size_t) + 1000000 * sizeof(int), stats.bytes);
+        V checkpoint = load(path);
+        ASSERT_EQ(1000000u, checkpoint.size());
+        // All elements are incremented in one update.
+        for (int e : checkpoint) {
+            ASSERT_EQ(checkpoint.front(), e);
+        }
+    }
+    stop.store(true);
+    writer.join();
+}
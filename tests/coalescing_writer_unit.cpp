@@ -0,0 +1,67 @@
+#include <coalescing_writer.hpp>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using V = std::vector<int>;
+using writer = coalescing_writer<V>;
+
+void push(writer& w, int x) {
+    w.update([x](V* v) { v->push_back(x); });
+}
+
+} // namespace
+
+struct CoalescingWriterTest : public ::testing::Test {
+    rcu_ptr<V> p{std::make_shared<V>()};
+};
+
+TEST_F(CoalescingWriterTest, publishes_full_batches) {
+    writer w(p, std::chrono::hours(1), 3);
+    push(w, 1);
+    push(w, 2);
+    ASSERT_EQ(2u, w.pending());
+    ASSERT_TRUE(p.read()->empty());
+
+    auto published = p.read();
+    ASSERT_TRUE(w.update([](V* v) { v->push_back(3); }));
+    ASSERT_EQ(0u, w.pending());
+    ASSERT_EQ((V{1, 2, 3}), *p.read());
+    // The published version was not modified in place.
+    ASSERT_TRUE(published->empty());
+}
+
+TEST_F(CoalescingWriterTest, publishes_after_interval) {
+    writer w(p, std::chrono::milliseconds(20));
+    push(w, 1);
+    ASSERT_FALSE(w.flush_if_due());
+    ASSERT_TRUE(p.read()->empty());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    ASSERT_TRUE(w.flush_if_due());
+    ASSERT_EQ(V{1}, *p.read());
+    ASSERT_FALSE(w.flush_if_due());
+
+    writer every(p, std::chrono::milliseconds(0));
+    ASSERT_TRUE(every.update([](V* v) { v->push_back(2); }));
+    ASSERT_EQ((V{1, 2}), *p.read());
+}
+
+TEST_F(CoalescingWriterTest, flush_forces_publication) {
+    {
+        writer w(p, std::chrono::hours(1));
+        push(w, 1);
+        ASSERT_TRUE(w.flush());
+        ASSERT_EQ(V{1}, *p.read());
+        ASSERT_FALSE(w.flush());
+        push(w, 2);
+    }
+    // The destructor flushes.
+    ASSERT_EQ((V{1, 2}), *p.read());
+}
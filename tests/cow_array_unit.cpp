@@ -0,0 +1,155 @@
+#include <cow_array.hpp>
+#include <tests/rcu_ptr_under_test.hpp>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+namespace {
+
+struct Record {
+    long id;
+    double price;
+    int qty;
+};
+
+const std::size_t per_block =
+    detail::cow_block_file::block_size() / sizeof(long);
+
+} // namespace
+
+struct CowArrayTest : public ::testing::Test {};
+
+TEST_F(CowArrayTest, construct) {
+    cow_array<long> a(10000, 7);
+    ASSERT_EQ(10000u, a.size());
+    for (long v : a) {
+        ASSERT_EQ(7, v);
+    }
+    cow_array<long> empty(0);
+    ASSERT_TRUE(empty.empty());
+    cow_array<long> copy(empty);
+    ASSERT_EQ(copy.begin(), copy.end());
+}
+
+TEST_F(CowArrayTest, copy_shares_blocks_until_written) {
+    cow_array<long> a(per_block * 100, 1);
+    cow_array<long> b(a);
+    ASSERT_EQ(0u, b.owned_blocks());
+    ASSERT_EQ(1, b[per_block * 50]);
+
+    b.write(per_block * 50) = 2;
+    b.write(per_block * 50 + 1) = 3;
+    ASSERT_EQ(1u, b.owned_blocks());
+    ASSERT_EQ(2, b[per_block * 50]);
+    ASSERT_EQ(3, b[per_block * 50 + 1]);
+    ASSERT_EQ(1, b[per_block * 50 + 2]);
+    ASSERT_EQ(1, a[per_block * 50]);
+
+    cow_array<long> c(b);
+    ASSERT_EQ(2, c[per_block * 50]);
+    c.write(0) = 4;
+    ASSERT_EQ(1, b[0]);
+    ASSERT_EQ(4, c[0]);
+}
+
+TEST_F(CowArrayTest, writing_the_original_leaves_the_copy) {
+    cow_array<int> a(4096, 1);
+    a.write(0) = 2;
+    cow_array<int> b(a);
+    ASSERT_EQ(0u, a.owned_blocks());
+    a.write(0) = 42;
+    a.write(a.size() - 1) = 43;
+    ASSERT_EQ(2, b[0]);
+    ASSERT_EQ(1, b[b.size() - 1]);
+    ASSERT_EQ(42, a[0]);
+    ASSERT_EQ(43, a[a.size() - 1]);
+
+    // b holds its blocks alone now, writing them copies nothing.
+    std::size_t used = b.owned_blocks();
+    b.write(0) = 3;
+    ASSERT_EQ(used, b.owned_blocks());
+    ASSERT_EQ(3, b[0]);
+    ASSERT_EQ(42, a[0]);
+}
+
+TEST_F(CowArrayTest, write_range_across_blocks) {
+    cow_array<Record> a(10000, Record{1, 1.0, 1});
+    cow_array<Record> b(a);
+    std::size_t bs = detail::cow_block_file::block_size();
+    // The first record which does not fit into the first block.
+    std::size_t i = bs / sizeof(Record);
+    Record* r = b.write(i, 1);
+    r->id = 42;
+    ASSERT_EQ(bs % sizeof(Record) == 0 ? 1u : 2u, b.owned_blocks());
+    ASSERT_EQ(42, b[i].id);
+    ASSERT_EQ(1, a[i].id);
+
+    Record* all = b.write(0, b.size());
+    all[b.size() - 1].qty = 5;
+    ASSERT_EQ(5, b[b.size() - 1].qty);
+    ASSERT_EQ(1, a[a.size() - 1].qty);
+}
+
+TEST_F(CowArrayTest, fragmented_copy_is_compacted) {
+    const std::size_t blocks = 3000;
+    cow_array<long> a(per_block * blocks, 1);
+    cow_array<long> b(a);
+    for (std::size_t i = 0; i < blocks; i += 2) {
+        b.write(i * per_block) = 2;
+    }
+    ASSERT_EQ(blocks / 2, b.owned_blocks());
+    cow_array<long> c(b);
+    ASSERT_EQ(blocks, c.owned_blocks());
+    for (std::size_t i = 0; i < blocks; ++i) {
+        ASSERT_EQ(i % 2 == 0 ? 2 : 1, c[i * per_block]);
+    }
+}
+
+TEST_F(CowArrayTest, file_stays_bounded_across_rewrites) {
+    const std::size_t blocks = 3000;
+    std::unique_ptr<cow_array<long>> a(
+        new cow_array<long>(per_block * blocks, 0));
+    std::size_t bound = 0;
+    for (long round = 1; round <= 20; ++round) {
+        // Every block is written, the copy is fragmented and compacted by
+        // the next copy.
+        std::unique_ptr<cow_array<long>> b(new cow_array<long>(*a));
+        for (std::size_t i = 0; i < blocks; ++i) {
+            b->write(i * per_block) = round;
+        }
+        a = std::move(b);
+        if (round == 2) bound = a->file_blocks();
+    }
+    ASSERT_EQ(bound, a->file_blocks());
+    ASSERT_EQ(20, (*a)[0]);
+    ASSERT_EQ(20, (*a)[(blocks - 1) * per_block]);
+}
+
+TEST_F(CowArrayTest, copy_update_while_reading) {
+    const std::size_t size = per_block * 256;
+    rcu_ptr_under_test<cow_array<long>> p(
+        asp_traits::make_shared<cow_array<long>>(size, 0));
+    std::atomic<bool> done{false};
+    // The first and the last record are updated together.
+    std::thread writer{[&]() {
+        for (long i = 1; i <= 500; ++i) {
+            p.copy_update([i, size](cow_array<long>* a) {
+                a->write(0) = i;
+                a->write(size - 1) = i;
+                a->write((i * 997) % size) = -1;
+            });
+        }
+        done.store(true);
+    }};
+    while (!done.load()) {
+        auto a = p.read();
+        ASSERT_EQ((*a)[0], (*a)[size - 1]);
+    }
+    writer.join();
+    auto a = p.read();
+    ASSERT_EQ(500, (*a)[0]);
+    ASSERT_EQ(500, (*a)[size - 1]);
+}
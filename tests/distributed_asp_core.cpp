@@ -0,0 +1,171 @@
+// distributed_asp_core.cpp
+//
+#include <detail/distributed_atomic_shared_ptr.hpp>
+#include <tests/ExecuteInLoop.hpp>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+using namespace detail::distributed;
+
+namespace {
+
+// Counts its live instances.
+struct Counted {
+    static std::atomic<int> live;
+    int value;
+    explicit Counted(int value) : value(value) { ++live; }
+    Counted(const Counted& other) : value(other.value) { ++live; }
+    ~Counted() { --live; }
+};
+std::atomic<int> Counted::live{0};
+
+} // namespace
+
+struct DistributedAtomicSharedPtrCore : public ::testing::Test {
+    void TearDown() override { ASSERT_EQ(0, Counted::live); }
+};
+
+TEST_F(DistributedAtomicSharedPtrCore, constructible) {
+    { atomic_shared_ptr<int> asp; }
+    { atomic_shared_ptr<int> asp(shared_ptr<int>{}); }
+    { atomic_shared_ptr<int> asp(make_shared<int>(13)); }
+    { atomic_shared_ptr<Counted> asp(make_shared<Counted>(13)); }
+}
+
+TEST_F(DistributedAtomicSharedPtrCore, shards_are_on_their_own_cache_lines) {
+    using detail::cache_line_size;
+    static_assert(alignof(node_t<char>) == cache_line_size, "");
+    static_assert(sizeof(detail::padded<std::atomic<long> >) == cache_line_size,
+                  "");
+    std::vector<shared_ptr<char> > nodes;
+    for (int i = 0; i < 16; ++i) {
+        nodes.push_back(make_shared<char>('a'));
+        // The value follows the cache line aligned shards and control.
+        ASSERT_EQ(0u, reinterpret_cast<std::uintptr_t>(nodes.back().get()) %
+                          cache_line_size);
+    }
+}
+
+TEST_F(DistributedAtomicSharedPtrCore, shared_ptr_releases_last_reference) {
+    {
+        auto sp = make_shared<Counted>(42);
+        auto sp2 = sp;
+        shared_ptr<const Counted> csp = std::move(sp);
+        ASSERT_FALSE(static_cast<bool>(sp));
+        ASSERT_EQ(42, csp->value);
+        ASSERT_EQ(1, Counted::live);
+    }
+    ASSERT_EQ(0, Counted::live);
+}
+
+TEST_F(DistributedAtomicSharedPtrCore, load_store_exchange) {
+    auto a = make_shared<Counted>(1);
+    auto b = make_shared<Counted>(2);
+    atomic_shared_ptr<Counted> asp(a);
+    ASSERT_EQ(a, asp.load());
+    asp.store(b);
+    ASSERT_EQ(b, asp.load());
+    auto old = asp.exchange(a);
+    ASSERT_EQ(b, old);
+    ASSERT_EQ(a, asp.load());
+}
+
+TEST_F(DistributedAtomicSharedPtrCore, stored_object_outlives_other_owners) {
+    atomic_shared_ptr<Counted> asp(make_shared<Counted>(1));
+    ASSERT_EQ(1, Counted::live);
+    ASSERT_EQ(1, asp.load()->value);
+    asp.store(shared_ptr<Counted>());
+    ASSERT_EQ(0, Counted::live);
+}
+
+// References taken on the shards while the node is published are moved to
+// the central count when it is replaced.
+TEST_F(DistributedAtomicSharedPtrCore, loaded_references_survive_the_collapse) {
+    atomic_shared_ptr<Counted> asp(make_shared<Counted>(1));
+    std::vector<shared_ptr<Counted>> loaded;
+    for (int i = 0; i < 1000; ++i) {
+        loaded.push_back(asp.load());
+    }
+    auto copies = loaded;
+    asp.store(make_shared<Counted>(2));
+    ASSERT_EQ(2, Counted::live);
+    loaded.clear();
+    ASSERT_EQ(2, Counted::live);
+    copies.pop_back();
+    ASSERT_EQ(2, Counted::live);
+    copies.clear();
+    ASSERT_EQ(1, Counted::live);
+}
+
+TEST_F(DistributedAtomicSharedPtrCore, references_released_by_other_threads) {
+    atomic_shared_ptr<Counted> asp(make_shared<Counted>(1));
+    std::vector<shared_ptr<Counted>> loaded;
+    std::thread t{[&]() {
+        for (int i = 0; i < 1000; ++i) {
+            loaded.push_back(asp.load());
+        }
+    }};
+    t.join();
+    asp.store(shared_ptr<Counted>());
+    ASSERT_EQ(1, Counted::live);
+    loaded.clear();
+    ASSERT_EQ(0, Counted::live);
+}
+
+TEST_F(DistributedAtomicSharedPtrCore, republished_node_is_counted_centrally) {
+    auto a = make_shared<Counted>(1);
+    atomic_shared_ptr<Counted> asp(a);
+    auto loaded = asp.load();
+    asp.store(shared_ptr<Counted>());
+    asp.store(a);
+    a.reset();
+    std::vector<shared_ptr<Counted>> more{asp.load(), asp.load()};
+    asp.store(shared_ptr<Counted>());
+    loaded.reset();
+    ASSERT_EQ(1, Counted::live);
+    more.clear();
+    ASSERT_EQ(0, Counted::live);
+}
+
+TEST_F(DistributedAtomicSharedPtrCore, compare_exchange) {
+    auto a = make_shared<Counted>(1);
+    auto b = make_shared<Counted>(2);
+    atomic_shared_ptr<Counted> asp(a);
+
+    auto expected = b;
+    auto desired = make_shared<Counted>(3);
+    ASSERT_FALSE(asp.compare_exchange_strong(expected, std::move(desired)));
+    ASSERT_EQ(a, expected);
+    // desired is left intact on failure.
+    ASSERT_TRUE(static_cast<bool>(desired));
+
+    ASSERT_TRUE(asp.compare_exchange_strong(expected, std::move(desired)));
+    ASSERT_EQ(3, asp.load()->value);
+}
+
+TEST_F(DistributedAtomicSharedPtrCore, concurrent_load_store) {
+    atomic_shared_ptr<Counted> asp(make_shared<Counted>(0));
+
+    std::thread t1{[&asp]() {
+        executeInLoop<10000>(
+            [&asp]() { asp.store(make_shared<Counted>(1)); });
+    }};
+    auto reader = [&asp]() {
+        executeInLoop<10000>([&asp]() {
+            auto sp = asp.load();
+            auto copy = sp;
+            ASSERT_LE(0, copy->value);
+        });
+    };
+    std::thread t2{reader};
+    std::thread t3{reader};
+
+    t1.join();
+    t2.join();
+    t3.join();
+    asp.store(shared_ptr<Counted>());
+}
@@ -0,0 +1,120 @@
+#include <history_rcu_ptr.hpp>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+namespace {
+
+using history = history_rcu_ptr<int>;
+
+void set(history& h, int x) {
+    h.copy_update([x](int* v) { *v = x; });
+}
+
+} // namespace
+
+struct HistoryRcuPtrTest : public ::testing::Test {
+    history h{4, history::clock::duration::zero(),
+              std::make_shared<const int>(0)};
+};
+
+TEST_F(HistoryRcuPtrTest, read_at_version) {
+    for (int i = 1; i <= 3; ++i) {
+        set(h, i * 10);
+    }
+    history::snapshot s;
+    for (std::uint64_t v = 0; v <= 3; ++v) {
+        ASSERT_TRUE(h.read_at(v, s));
+        ASSERT_EQ(v, s.version());
+        ASSERT_EQ(int(v) * 10, *s);
+    }
+    ASSERT_FALSE(h.read_at(4, s));
+}
+
+TEST_F(HistoryRcuPtrTest, capacity_evicts_old_versions) {
+    for (int i = 1; i <= 10; ++i) {
+        set(h, i);
+    }
+    history::snapshot s;
+    ASSERT_FALSE(h.read_at(6, s));
+    for (std::uint64_t v = 7; v <= 10; ++v) {
+        ASSERT_TRUE(h.read_at(v, s));
+        ASSERT_EQ(int(v), *s);
+    }
+}
+
+TEST_F(HistoryRcuPtrTest, snapshot_outlives_eviction) {
+    history::snapshot s;
+    ASSERT_TRUE(h.read_at(0, s));
+    for (int i = 1; i <= 10; ++i) {
+        set(h, i);
+    }
+    ASSERT_EQ(0, *s);
+}
+
+TEST_F(HistoryRcuPtrTest, read_at_time) {
+    auto before = history::clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    set(h, 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    auto between = history::clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    set(h, 2);
+
+    history::snapshot s;
+    ASSERT_TRUE(h.read_at(before, s));
+    ASSERT_EQ(0u, s.version());
+    ASSERT_TRUE(h.read_at(between, s));
+    ASSERT_EQ(1, *s);
+    ASSERT_LE(s.time(), between);
+    ASSERT_TRUE(h.read_at(history::clock::now(), s));
+    ASSERT_EQ(2, *s);
+    ASSERT_FALSE(h.read_at(before - std::chrono::hours(1), s));
+}
+
+TEST_F(HistoryRcuPtrTest, max_age_evicts_old_versions) {
+    history aged(64, std::chrono::milliseconds(20),
+                 std::make_shared<const int>(0));
+    set(aged, 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    set(aged, 2);
+    set(aged, 3);
+
+    history::snapshot s;
+    // Version 0 was replaced by 1 long ago, 1 was replaced just now.
+    ASSERT_FALSE(aged.read_at(0, s));
+    ASSERT_TRUE(aged.read_at(1, s));
+    ASSERT_TRUE(aged.read_at(2, s));
+    ASSERT_TRUE(aged.read_at(3, s));
+}
+
+TEST_F(HistoryRcuPtrTest, read_at_while_writing) {
+    history big(16, std::chrono::milliseconds(1),
+                std::make_shared<const int>(0));
+    std::atomic<bool> done{false};
+    std::thread writer{[&]() {
+        for (int i = 1; i <= 20000; ++i) {
+            set(big, i);
+        }
+        done.store(true);
+    }};
+    history::snapshot s;
+    while (!done.load()) {
+        auto cur = big.read();
+        for (std::uint64_t v = cur.version() + 1; v-- > 0;) {
+            if (!big.read_at(v, s)) break;
+            ASSERT_EQ(v, s.version());
+            ASSERT_EQ(int(v), *s);
+            if (cur.version() - v > 20) break;
+        }
+        if (big.read_at(history::clock::now(), s)) {
+            ASSERT_EQ(int(s.version()), *s);
+        }
+    }
+    writer.join();
+}
@@ -0,0 +1,73 @@
+// huge_page_asp_core.cpp
+//
+#include <detail/huge_page_atomic_shared_ptr_traits.hpp>
+#include <tests/rcu_ptr_under_test.hpp>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+using namespace detail;
+
+namespace {
+
+using traits =
+    huge_pages::atomic_shared_ptr_traits<detail::__std::atomic_shared_ptr>;
+
+bool huge_page_aligned(const void* p) {
+    return reinterpret_cast<std::uintptr_t>(p) % huge_page_size == 0;
+}
+
+} // namespace
+
+TEST(HugePageAllocatorTest, places_large_blocks_on_huge_page_boundaries) {
+    huge_page_allocator<long> a;
+    std::size_t n = 3 * huge_page_size / sizeof(long) + 1;
+    long* p = a.allocate(n);
+    ASSERT_TRUE(huge_page_aligned(p));
+    p[0] = 1;
+    p[n - 1] = 2;
+    a.deallocate(p, n);
+}
+
+TEST(HugePageAllocatorTest, small_blocks_are_on_the_heap) {
+    huge_page_allocator<int> a;
+    int* p = a.allocate(16);
+    p[15] = 1;
+    a.deallocate(p, 16);
+}
+
+TEST(HugePageAllocatorTest, explicit_pool_falls_back_to_transparent_pages) {
+    // Works whether or not the system has reserved huge pages.
+    huge_page_allocator<char, huge_page_mode::explicit_pool> a;
+    char* p = a.allocate(huge_page_size);
+    ASSERT_TRUE(huge_page_aligned(p));
+    p[huge_page_size - 1] = 1;
+    a.deallocate(p, huge_page_size);
+}
+
+TEST(HugePageAllocatorTest, vector_with_stream_copy) {
+    using A = default_init_allocator<int, huge_page_allocator<int> >;
+    using V = std::vector<int, A>;
+    std::size_t n = huge_page_size / sizeof(int);
+    rcu_ptr<V, detail::__std::atomic_shared_ptr, traits> p(
+        traits::make_shared<V>(n, 1));
+    ASSERT_TRUE(huge_page_aligned(p.read()->data()));
+    p.copy_update([](V* v) { (*v)[0] = 2; });
+    auto v = p.read();
+    ASSERT_TRUE(huge_page_aligned(v->data()));
+    ASSERT_EQ(static_cast<long>(n + 1),
+              std::accumulate(v->begin(), v->end(), 0L));
+}
+
+TEST(HugePageAllocatorTest, traits_place_large_versions_in_huge_pages) {
+    using A = std::array<long, huge_page_size / sizeof(long)>;
+    rcu_ptr<A, detail::__std::atomic_shared_ptr, traits> p(
+        traits::make_shared<A>());
+    ASSERT_EQ(0, p.read()->back());
+    p.copy_update([](A* a) { a->back() = 3; });
+    ASSERT_EQ(3, p.read()->back());
+    ASSERT_EQ(0, p.read()->front());
+}
@@ -0,0 +1,88 @@
+#include <inline_rcu_ptr.hpp>
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct pair16 {
+    std::int64_t a;
+    std::int64_t b; // always -a
+};
+
+struct config {
+    int limit;
+    double ratio;
+    char name[12];
+};
+
+} // namespace
+
+struct InlineRcuPtrTest : public ::testing::Test {};
+
+TEST_F(InlineRcuPtrTest, storage_by_size) {
+    static_assert(inline_rcu_ptr<int>::is_atomic, "");
+    static_assert(inline_rcu_ptr<double>::is_atomic, "");
+    static_assert(!inline_rcu_ptr<pair16>::is_atomic, "");
+    static_assert(!inline_rcu_ptr<config>::is_atomic, "");
+}
+
+TEST_F(InlineRcuPtrTest, read_reset_and_copy_update) {
+    inline_rcu_ptr<int> p;
+    ASSERT_EQ(0, p.read());
+    p.reset(42);
+    p.copy_update([](int* v) { *v += 1; });
+    ASSERT_EQ(43, p.read());
+    p = 7;
+    ASSERT_EQ(7, p.read());
+
+    inline_rcu_ptr<config> c(config{1, 0.5, "first"});
+    c.copy_update([](config* v) { v->limit = 10; });
+    config r = c.read();
+    ASSERT_EQ(10, r.limit);
+    ASSERT_EQ(0.5, r.ratio);
+    ASSERT_STREQ("first", r.name);
+}
+
+template <typename T, typename Check>
+void concurrent_increments(Check check) {
+    inline_rcu_ptr<T> p;
+    const int writers = 3, increments = 20000;
+    std::vector<std::thread> threads;
+    std::atomic<bool> done{false};
+    threads.emplace_back([&]() {
+        while (!done.load()) {
+            check(p.read());
+        }
+    });
+    for (int w = 0; w < writers; ++w) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < increments; ++i) {
+                p.copy_update([](T* v) {
+                    ++v->a;
+                    v->b = -v->a;
+                });
+            }
+        });
+    }
+    for (std::size_t t = 1; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    done.store(true);
+    threads[0].join();
+    ASSERT_EQ(writers * increments, p.read().a);
+}
+
+TEST_F(InlineRcuPtrTest, concurrent_copy_updates_are_not_lost) {
+    struct pair8 {
+        std::int32_t a;
+        std::int32_t b;
+    };
+    concurrent_increments<pair8>(
+        [](const pair8& v) { ASSERT_EQ(-v.a, v.b); });
+    concurrent_increments<pair16>(
+        [](const pair16& v) { ASSERT_EQ(-v.a, v.b); });
+}
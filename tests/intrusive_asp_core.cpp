@@ -0,0 +1,134 @@
+// intrusive_asp_core.cpp
+//
+#include <detail/intrusive_atomic_shared_ptr.hpp>
+#include <tests/ExecuteInLoop.hpp>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace detail::intrusive;
+
+namespace {
+
+// Intrusively counted type which counts its live instances.
+struct Counted : ref_counter {
+    static std::atomic<int> live;
+    int value;
+    explicit Counted(int value) : value(value) { ++live; }
+    Counted(const Counted& other) : ref_counter(other), value(other.value) {
+        ++live;
+    }
+    ~Counted() { --live; }
+};
+std::atomic<int> Counted::live{0};
+
+} // namespace
+
+struct IntrusiveAtomicSharedPtrCore : public ::testing::Test {
+    void TearDown() override { ASSERT_EQ(0, Counted::live); }
+};
+
+TEST_F(IntrusiveAtomicSharedPtrCore, constructible) {
+    { atomic_shared_ptr<int> asp; }
+    { atomic_shared_ptr<int> asp(shared_ptr<int>{}); }
+    { atomic_shared_ptr<int> asp(make_shared<int>(13)); }
+    { atomic_shared_ptr<Counted> asp(make_shared<Counted>(13)); }
+}
+
+TEST_F(IntrusiveAtomicSharedPtrCore, is_lock_free) {
+    atomic_shared_ptr<int> asp;
+    ASSERT_TRUE(asp.is_lock_free());
+}
+
+TEST_F(IntrusiveAtomicSharedPtrCore, shared_ptr_releases_last_reference) {
+    {
+        auto sp = make_shared<Counted>(42);
+        ASSERT_EQ(1, Counted::live);
+        auto sp2 = sp;
+        shared_ptr<const Counted> csp = std::move(sp);
+        ASSERT_FALSE(static_cast<bool>(sp));
+        ASSERT_EQ(42, csp->value);
+        ASSERT_EQ(1, Counted::live);
+    }
+    ASSERT_EQ(0, Counted::live);
+}
+
+TEST_F(IntrusiveAtomicSharedPtrCore, copy_starts_unshared) {
+    auto sp = make_shared<Counted>(42);
+    auto cp = make_shared<Counted>(*sp);
+    sp.reset();
+    ASSERT_EQ(1, Counted::live);
+    ASSERT_EQ(42, cp->value);
+}
+
+TEST_F(IntrusiveAtomicSharedPtrCore, load_store_exchange) {
+    auto a = make_shared<Counted>(1);
+    auto b = make_shared<Counted>(2);
+    atomic_shared_ptr<Counted> asp(a);
+    ASSERT_EQ(a, asp.load());
+    asp.store(b);
+    ASSERT_EQ(b, asp.load());
+    auto old = asp.exchange(a);
+    ASSERT_EQ(b, old);
+    ASSERT_EQ(a, asp.load());
+}
+
+TEST_F(IntrusiveAtomicSharedPtrCore, stored_object_outlives_other_owners) {
+    atomic_shared_ptr<Counted> asp(make_shared<Counted>(1));
+    ASSERT_EQ(1, Counted::live);
+    ASSERT_EQ(1, asp.load()->value);
+    asp.store(shared_ptr<Counted>());
+    ASSERT_EQ(0, Counted::live);
+}
+
+TEST_F(IntrusiveAtomicSharedPtrCore, many_loads_refill_the_local_count) {
+    atomic_shared_ptr<Counted> asp(make_shared<Counted>(1));
+    std::vector<shared_ptr<Counted>> loaded;
+    for (int i = 0; i < 100000; ++i) {
+        loaded.push_back(asp.load());
+    }
+    asp.store(make_shared<Counted>(2));
+    ASSERT_EQ(2, Counted::live);
+    loaded.clear();
+    ASSERT_EQ(1, Counted::live);
+}
+
+TEST_F(IntrusiveAtomicSharedPtrCore, compare_exchange) {
+    auto a = make_shared<Counted>(1);
+    auto b = make_shared<Counted>(2);
+    atomic_shared_ptr<Counted> asp(a);
+
+    auto expected = b;
+    auto desired = make_shared<Counted>(3);
+    ASSERT_FALSE(asp.compare_exchange_strong(expected, std::move(desired)));
+    ASSERT_EQ(a, expected);
+    // desired is left intact on failure.
+    ASSERT_TRUE(static_cast<bool>(desired));
+
+    ASSERT_TRUE(asp.compare_exchange_strong(expected, std::move(desired)));
+    ASSERT_EQ(3, asp.load()->value);
+}
+
+TEST_F(IntrusiveAtomicSharedPtrCore, concurrent_load_store) {
+    atomic_shared_ptr<Counted> asp(make_shared<Counted>(0));
+
+    std::thread t1{[&asp]() {
+        executeInLoop<10000>(
+            [&asp]() { asp.store(make_shared<Counted>(1)); });
+    }};
+    auto reader = [&asp]() {
+        executeInLoop<10000>([&asp]() {
+            auto sp = asp.load();
+            ASSERT_LE(0, sp->value);
+        });
+    };
+    std::thread t2{reader};
+    std::thread t3{reader};
+
+    t1.join();
+    t2.join();
+    t3.join();
+    asp.store(shared_ptr<Counted>());
+}
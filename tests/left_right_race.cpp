@@ -0,0 +1,77 @@
+#include <left_right.hpp>
+#include <tests/ExecuteInLoop.hpp>
+
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <thread>
+#include <vector>
+
+struct LeftRightRaceTest : public ::testing::Test {};
+
+TEST_F(LeftRightRaceTest, read_update) {
+    left_right<int> lr(0);
+
+    std::thread t1{[&lr]() {
+        executeInLoop<10000>([&lr]() { lr.update([](auto cp) { ++*cp; }); });
+    }};
+
+    int last = 0;
+    executeInLoop<10000>([&lr, &last]() {
+        int current = *lr.read();
+        // Readers never see a value going backwards.
+        ASSERT_LE(last, current);
+        last = current;
+    });
+
+    t1.join();
+    ASSERT_EQ(10000, *lr.read());
+}
+
+TEST_F(LeftRightRaceTest, update_update) {
+    left_right<int> lr(0);
+
+    auto l = [&lr]() {
+        executeInLoop<10000>([&lr]() { lr.update([](auto cp) { ++*cp; }); });
+    };
+
+    std::thread t1{l};
+    std::thread t2{l};
+
+    t1.join();
+    t2.join();
+
+    ASSERT_EQ(20000, *lr.read());
+}
+
+TEST_F(LeftRightRaceTest, readers_see_consistent_vector) {
+    using V = std::vector<int>;
+    left_right<V> lr(V(100, 0));
+
+    std::thread t1{[&lr]() {
+        executeInLoop<1000>([&lr]() {
+            lr.update([](V* v) {
+                for (auto& e : *v) {
+                    ++e;
+                }
+            });
+        });
+    }};
+
+    auto reader = [&lr]() {
+        executeInLoop<1000>([&lr]() {
+            auto const current = lr.read();
+            // All elements are incremented in one update.
+            ASSERT_EQ(current->front() * 100,
+                      std::accumulate(current->begin(), current->end(), 0));
+        });
+    };
+    std::thread t2{reader};
+    std::thread t3{reader};
+
+    t1.join();
+    t2.join();
+    t3.join();
+
+    ASSERT_EQ(1000, lr.read()->back());
+}
@@ -0,0 +1,69 @@
+#include <left_right.hpp>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct LeftRightCoreTest : public ::testing::Test {};
+
+TEST_F(LeftRightCoreTest, default_constructible) {
+    left_right<int> lr;
+    ASSERT_EQ(0, *lr.read());
+}
+
+TEST_F(LeftRightCoreTest, constructible_from_value) {
+    left_right<int> lr(42);
+    auto const current = lr.read();
+    ASSERT_TRUE(static_cast<bool>(current));
+    ASSERT_EQ(42, *current);
+}
+
+TEST_F(LeftRightCoreTest, update_modifies_both_instances) {
+    left_right<std::vector<int>> lr;
+    int calls = 0;
+    lr.update([&calls](auto v) {
+        ++calls;
+        v->push_back(1);
+    });
+    ASSERT_EQ(2, calls);
+    ASSERT_EQ(1u, lr.read()->size());
+
+    // The next update starts on the other instance.
+    lr.update([](auto v) { v->push_back(2); });
+    auto const current = lr.read();
+    ASSERT_EQ((std::vector<int>{1, 2}), *current);
+}
+
+TEST_F(LeftRightCoreTest, read_handle_is_movable) {
+    left_right<int> lr(42);
+    auto h1 = lr.read();
+    auto h2 = std::move(h1);
+    ASSERT_FALSE(static_cast<bool>(h1));
+    ASSERT_EQ(42, *h2);
+}
+
+TEST_F(LeftRightCoreTest, read_handle_released_on_another_thread) {
+    left_right<int> lr(42);
+    for (int i = 0; i < 100; ++i) {
+        auto h = lr.read();
+        std::thread t{[h = std::move(h)]() mutable {
+            ASSERT_EQ(42, *h);
+            h = {};
+        }};
+        t.join();
+        // Hangs if the handle departed at the counter of the other thread.
+        lr.update([](int*) {});
+    }
+}
+
+TEST_F(LeftRightCoreTest, new_aligns_to_a_cache_line) {
+    for (int i = 0; i < 16; ++i) {
+        std::unique_ptr<left_right<char> > lr(new left_right<char>('a'));
+        ASSERT_EQ(0u, reinterpret_cast<std::uintptr_t>(lr.get()) %
+                          detail::cache_line_size);
+        ASSERT_EQ('a', *lr->read());
+    }
+}
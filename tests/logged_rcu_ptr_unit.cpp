@@ -0,0 +1,153 @@
+#include <logged_rcu_ptr.hpp>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using V = std::vector<int>;
+using feed_t = logged_rcu_ptr<V, int>;
+
+void push(feed_t& f, int x) {
+    f.copy_update([x](V* v, int& delta) {
+        v->push_back(x);
+        delta = x;
+    });
+}
+
+// Derived state: the sum of the elements.
+struct summer {
+    long sum = 0;
+    int deltas = 0;
+    int snapshots = 0;
+
+    void poll(feed_t::subscriber& s) {
+        s.poll(
+            [this](std::uint64_t, int delta) {
+                sum += delta;
+                ++deltas;
+            },
+            [this](const feed_t::snapshot& snap) {
+                sum = snap ? std::accumulate(snap->begin(), snap->end(), 0L)
+                           : 0;
+                ++snapshots;
+            });
+    }
+};
+
+} // namespace
+
+struct LoggedRcuPtrTest : public ::testing::Test {
+    feed_t f{4, std::make_shared<const V>()};
+};
+
+TEST_F(LoggedRcuPtrTest, versions) {
+    ASSERT_EQ(0u, f.read().version());
+    ASSERT_EQ(1u, f.copy_update([](V* v, int&) { v->push_back(1); }));
+    ASSERT_EQ(2u, f.reset(std::make_shared<const V>(V{2, 3})));
+    auto s = f.read();
+    ASSERT_EQ(2u, s.version());
+    ASSERT_EQ((V{2, 3}), *s);
+}
+
+TEST_F(LoggedRcuPtrTest, copy_update_of_null) {
+    feed_t empty;
+    empty.copy_update([](V* v, int&) { ASSERT_EQ(nullptr, v); });
+    ASSERT_FALSE(empty.read());
+    ASSERT_EQ(1u, empty.read().version());
+}
+
+TEST_F(LoggedRcuPtrTest, deltas_in_order) {
+    feed_t::subscriber s(f);
+    std::vector<std::uint64_t> versions;
+    std::vector<int> deltas;
+    auto on_delta = [&](std::uint64_t version, int delta) {
+        versions.push_back(version);
+        deltas.push_back(delta);
+    };
+    auto on_snapshot = [](const feed_t::snapshot&) { FAIL(); };
+
+    ASSERT_EQ(0u, s.poll(on_delta, on_snapshot));
+    push(f, 10);
+    push(f, 20);
+    ASSERT_EQ(2u, s.poll(on_delta, on_snapshot));
+    push(f, 30);
+    ASSERT_EQ(1u, s.poll(on_delta, on_snapshot));
+    ASSERT_EQ((std::vector<std::uint64_t>{1, 2, 3}), versions);
+    ASSERT_EQ((std::vector<int>{10, 20, 30}), deltas);
+    ASSERT_EQ(3u, s.version());
+}
+
+TEST_F(LoggedRcuPtrTest, subscriber_behind_the_ring_resyncs) {
+    feed_t::subscriber s(f);
+    summer sum;
+    for (int i = 1; i <= 10; ++i) {
+        push(f, i);
+    }
+    sum.poll(s);
+    ASSERT_EQ(55, sum.sum);
+    ASSERT_EQ(1, sum.snapshots);
+    ASSERT_EQ(0, sum.deltas);
+    ASSERT_EQ(10u, s.version());
+
+    push(f, 11);
+    sum.poll(s);
+    ASSERT_EQ(66, sum.sum);
+    ASSERT_EQ(1, sum.deltas);
+}
+
+TEST_F(LoggedRcuPtrTest, reset_resyncs) {
+    feed_t::subscriber s(f);
+    summer sum;
+    push(f, 1);
+    f.reset(std::make_shared<const V>(V{5, 5}));
+    push(f, 2);
+    sum.poll(s);
+    ASSERT_EQ(12, sum.sum);
+    ASSERT_EQ(1, sum.snapshots);
+    ASSERT_EQ(3u, s.version());
+}
+
+TEST_F(LoggedRcuPtrTest, subscriber_follows_concurrent_writers) {
+    feed_t big{64, std::make_shared<const V>()};
+    const int writers = 2, n = 5000;
+    std::atomic<int> done{0};
+    auto writer = [&]() {
+        for (int i = 1; i <= n; ++i) {
+            big.copy_update([i](V* v, int& delta) {
+                v->push_back(i);
+                delta = i;
+            });
+        }
+        ++done;
+    };
+    feed_t::subscriber s(big);
+    std::thread t1{writer};
+    std::thread t2{writer};
+    long sum = 0;
+    std::uint64_t last = 0;
+    auto on_delta = [&](std::uint64_t version, int delta) {
+        ASSERT_EQ(last + 1, version);
+        last = version;
+        sum += delta;
+    };
+    auto on_snapshot = [&](const feed_t::snapshot& snap) {
+        ASSERT_LT(last, snap.version());
+        last = snap.version();
+        sum = std::accumulate(snap->begin(), snap->end(), 0L);
+    };
+    while (done.load() < writers) {
+        s.poll(on_delta, on_snapshot);
+    }
+    t1.join();
+    t2.join();
+    s.poll(on_delta, on_snapshot);
+    ASSERT_EQ(std::uint64_t(writers * n), s.version());
+    ASSERT_EQ(long(writers) * n * (n + 1) / 2, sum);
+}
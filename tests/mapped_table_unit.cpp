@@ -0,0 +1,134 @@
+#include <mapped_table.hpp>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Record {
+    int id;
+    double price;
+};
+
+// A fresh directory for the files of a test.
+struct MappedTableTest : public ::testing::Test {
+    std::string dir;
+    std::string path;
+
+    void SetUp() override {
+        char tmpl[] = "/tmp/mapped_table_test.XXXXXX";
+        ASSERT_NE(nullptr, ::mkdtemp(tmpl));
+        dir = tmpl;
+        path = dir + "/records.tbl";
+    }
+    void TearDown() override {
+        std::remove(path.c_str());
+        ::rmdir(dir.c_str());
+    }
+
+    void write(int n, double price) {
+        std::vector<Record> records;
+        for (int i = 0; i < n; ++i) {
+            records.push_back({i, price});
+        }
+        write_mapped_table(path, records.data(), records.size());
+    }
+};
+
+template <typename F>
+bool eventually(F&& condition) {
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+} // namespace
+
+TEST_F(MappedTableTest, maps_the_records) {
+    write(1000, 1.5);
+    mapped_table<Record> t(path);
+    ASSERT_EQ(1000u, t.size());
+    ASSERT_EQ(999, t[999].id);
+    double sum = 0;
+    for (const auto& r : t) {
+        sum += r.price;
+    }
+    ASSERT_EQ(1500.0, sum);
+}
+
+TEST_F(MappedTableTest, empty_table) {
+    write(0, 0);
+    mapped_table<Record> t(path);
+    ASSERT_TRUE(t.empty());
+    ASSERT_EQ(t.begin(), t.end());
+}
+
+TEST_F(MappedTableTest, rejects_invalid_files) {
+    ASSERT_THROW(mapped_table<Record>(dir + "/missing"), std::system_error);
+
+    write(10, 1);
+    ASSERT_THROW(mapped_table<int>{path}, std::runtime_error);
+
+    std::ofstream(path) << "not a table, but long enough to hold a header. "
+                           "....................................";
+    ASSERT_THROW(mapped_table<Record>{path}, std::runtime_error);
+}
+
+TEST_F(MappedTableTest, rejects_truncated_files) {
+    write(10, 1);
+    ASSERT_EQ(0, ::truncate(path.c_str(),
+                            mapped_table<Record>::data_offset +
+                                5 * sizeof(Record)));
+    ASSERT_THROW(mapped_table<Record>{path}, std::runtime_error);
+}
+
+TEST_F(MappedTableTest, load_publishes_to_rcu_ptr) {
+    write(10, 1);
+    rcu_ptr<mapped_table<Record>> table;
+    mapped_table_loader<Record> loader(table, path);
+    loader.load();
+    auto first = table.read();
+    ASSERT_EQ(10u, first->size());
+
+    write(20, 2);
+    loader.load();
+    ASSERT_EQ(20u, table.read()->size());
+    // The old version stays mapped while it is read.
+    ASSERT_EQ(10u, first->size());
+    ASSERT_EQ(1.0, (*first)[9].price);
+    ASSERT_EQ(2u, loader.load_count());
+}
+
+TEST_F(MappedTableTest, watch_reloads_changed_file) {
+    write(10, 1);
+    rcu_ptr<mapped_table<Record>> table;
+    std::atomic<int> errors{0};
+    mapped_table_loader<Record> loader(
+        table, path, [&errors](const std::exception&) { ++errors; });
+    loader.load();
+    loader.watch();
+
+    write(20, 2);
+    ASSERT_TRUE(eventually([&]() { return table.read()->size() == 20u; }));
+
+    // A broken file is reported and the current version is kept. It is
+    // renamed over the mapped one, like write_mapped_table does.
+    std::ofstream(path + ".broken") << "broken";
+    ASSERT_EQ(0, std::rename((path + ".broken").c_str(), path.c_str()));
+    ASSERT_TRUE(eventually([&]() { return errors > 0; }));
+    ASSERT_EQ(20u, table.read()->size());
+
+    write(30, 3);
+    ASSERT_TRUE(eventually([&]() { return table.read()->size() == 30u; }));
+    loader.unwatch();
+}
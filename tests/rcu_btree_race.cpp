@@ -0,0 +1,80 @@
+#include <rcu_btree.hpp>
+#include <tests/ExecuteInLoop.hpp>
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+struct RcuBtreeRaceTest : public ::testing::Test {};
+
+TEST_F(RcuBtreeRaceTest, insert_insert) {
+    rcu_btree<int, int> t;
+
+    auto writer = [&t](int offset) {
+        return [&t, offset]() {
+            for (int i = 0; i < 2000; ++i) {
+                t.insert_or_assign(offset + 2 * i, i);
+            }
+        };
+    };
+    std::thread t1{writer(0)};
+    std::thread t2{writer(1)};
+    t1.join();
+    t2.join();
+
+    auto s = t.read();
+    ASSERT_EQ(4000u, s.size());
+    int expected = 0;
+    for (const auto& e : s) {
+        ASSERT_EQ(expected++, e.first);
+    }
+}
+
+TEST_F(RcuBtreeRaceTest, scans_see_consistent_snapshots) {
+    rcu_btree<int, int> t;
+    for (int i = 0; i < 100; ++i) {
+        t.insert_or_assign(i, 0);
+    }
+
+    // Each update moves one unit from one key to another, so the sum of a
+    // consistent snapshot is always zero.
+    std::thread t1{[&t]() {
+        for (int i = 0; i < 2000; ++i) {
+            int from = i % 100, to = (i * 7 + 1) % 100;
+            auto s = t.read();
+            int a = *s.find(from), b = *s.find(to);
+            if (from == to) continue;
+            t.insert_or_assign(from, a - 1);
+            t.insert_or_assign(to, b + 1);
+            t.insert_or_assign(1000 + i, 0);
+            t.erase(1000 + i);
+        }
+    }};
+
+    auto reader = [&t]() {
+        executeInLoop<1000>([&t]() {
+            auto s = t.read();
+            std::size_t n = 0;
+            int last = -1;
+            for (const auto& e : s) {
+                ASSERT_LT(last, e.first);
+                last = e.first;
+                ++n;
+            }
+            ASSERT_EQ(s.size(), n);
+        });
+    };
+    std::thread t2{reader};
+    std::thread t3{reader};
+
+    t1.join();
+    t2.join();
+    t3.join();
+
+    int sum = 0;
+    for (const auto& e : t.read()) {
+        sum += e.second;
+    }
+    ASSERT_EQ(0, sum);
+    ASSERT_EQ(100u, t.size());
+}
@@ -0,0 +1,115 @@
+#include <rcu_btree.hpp>
+#include <gtest/gtest.h>
+
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+struct RcuBtreeCoreTest : public ::testing::Test {};
+
+TEST_F(RcuBtreeCoreTest, empty) {
+    rcu_btree<int, int> t;
+    int v = 0;
+    ASSERT_FALSE(t.find(1, v));
+    ASSERT_EQ(0u, t.size());
+    auto s = t.read();
+    ASSERT_TRUE(s.empty());
+    ASSERT_TRUE(s.begin() == s.end());
+}
+
+TEST_F(RcuBtreeCoreTest, insert_or_assign) {
+    rcu_btree<int, std::string> t;
+    ASSERT_TRUE(t.insert_or_assign(2, "two"));
+    ASSERT_TRUE(t.insert_or_assign(1, "one"));
+    ASSERT_FALSE(t.insert_or_assign(2, "deux"));
+    ASSERT_EQ(2u, t.size());
+    std::string v;
+    ASSERT_TRUE(t.find(2, v));
+    ASSERT_EQ("deux", v);
+    ASSERT_FALSE(t.contains(3));
+}
+
+TEST_F(RcuBtreeCoreTest, iterates_in_order) {
+    rcu_btree<int, int> t;
+    std::vector<int> keys;
+    for (int i = 0; i < 1000; ++i) {
+        keys.push_back(i);
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937{42});
+    for (int k : keys) {
+        t.insert_or_assign(k, -k);
+    }
+    auto s = t.read();
+    ASSERT_EQ(1000u, s.size());
+    int expected = 0;
+    for (const auto& e : s) {
+        ASSERT_EQ(expected, e.first);
+        ASSERT_EQ(-expected, e.second);
+        ++expected;
+    }
+    ASSERT_EQ(1000, expected);
+}
+
+TEST_F(RcuBtreeCoreTest, range_scan) {
+    rcu_btree<int, int> t;
+    for (int i = 0; i < 500; ++i) {
+        t.insert_or_assign(i * 2, i);
+    }
+    auto s = t.read();
+    std::vector<int> found;
+    s.for_each(101, 121, [&found](const std::pair<int, int>& e) {
+        found.push_back(e.first);
+    });
+    ASSERT_EQ((std::vector<int>{102, 104, 106, 108, 110, 112, 114, 116, 118,
+                                120}),
+              found);
+    ASSERT_EQ(998, s.lower_bound(997)->first);
+    ASSERT_TRUE(s.lower_bound(999) == s.end());
+}
+
+TEST_F(RcuBtreeCoreTest, snapshot_does_not_see_later_updates) {
+    rcu_btree<int, int> t;
+    for (int i = 0; i < 100; ++i) {
+        t.insert_or_assign(i, i);
+    }
+    auto before = t.read();
+    for (int i = 100; i < 200; ++i) {
+        t.insert_or_assign(i, i);
+    }
+    t.insert_or_assign(0, 42);
+    t.erase(1);
+    ASSERT_EQ(100u, before.size());
+    ASSERT_EQ(0, *before.find(0));
+    ASSERT_TRUE(before.contains(1));
+    ASSERT_FALSE(before.contains(150));
+    ASSERT_EQ(100, std::distance(before.begin(), before.end()));
+}
+
+TEST_F(RcuBtreeCoreTest, erase_matches_std_map) {
+    rcu_btree<int, int> t;
+    std::map<int, int> reference;
+    std::mt19937 random_engine{7};
+    std::uniform_int_distribution<int> key(0, 2000);
+    for (int i = 0; i < 20000; ++i) {
+        int k = key(random_engine);
+        if (i % 3 == 0) {
+            ASSERT_EQ(reference.erase(k) == 1, t.erase(k));
+        } else {
+            ASSERT_EQ(reference.emplace(k, i).second,
+                      t.insert_or_assign(k, i));
+            reference[k] = i;
+        }
+    }
+    auto s = t.read();
+    ASSERT_EQ(reference.size(), s.size());
+    using entries = std::vector<std::pair<int, int>>;
+    ASSERT_EQ(entries(reference.begin(), reference.end()),
+              entries(s.begin(), s.end()));
+
+    for (const auto& e : reference) {
+        ASSERT_TRUE(t.erase(e.first));
+    }
+    ASSERT_EQ(0u, t.size());
+    ASSERT_TRUE(t.read().begin() == t.read().end());
+}
@@ -0,0 +1,88 @@
+#include <rcu_hash_map.hpp>
+#include <tests/ExecuteInLoop.hpp>
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+struct RcuHashMapRaceTest : public ::testing::Test {};
+
+TEST_F(RcuHashMapRaceTest, insert_insert_while_resizing) {
+    rcu_hash_map<int, int> m(1);
+
+    auto writer = [&m](int offset) {
+        return [&m, offset]() {
+            for (int i = 0; i < 2000; ++i) {
+                m.insert_or_assign(offset + i, i);
+            }
+        };
+    };
+    std::thread t1{writer(0)};
+    std::thread t2{writer(100000)};
+    t1.join();
+    t2.join();
+
+    ASSERT_EQ(4000u, m.size());
+    for (int i = 0; i < 2000; ++i) {
+        ASSERT_TRUE(m.contains(i));
+        ASSERT_TRUE(m.contains(100000 + i));
+    }
+}
+
+TEST_F(RcuHashMapRaceTest, read_update_same_key) {
+    rcu_hash_map<int, int> m;
+    m.insert_or_assign(0, 0);
+
+    std::thread t1{[&m]() {
+        for (int i = 1; i <= 10000; ++i) {
+            m.insert_or_assign(0, i);
+        }
+    }};
+
+    int last = 0;
+    executeInLoop<10000>([&m, &last]() {
+        int current = -1;
+        ASSERT_TRUE(m.find(0, current));
+        // Readers never see a value going backwards.
+        ASSERT_LE(last, current);
+        last = current;
+    });
+
+    t1.join();
+    int v = 0;
+    ASSERT_TRUE(m.find(0, v));
+    ASSERT_EQ(10000, v);
+}
+
+TEST_F(RcuHashMapRaceTest, readers_keep_finding_keys_while_resizing) {
+    rcu_hash_map<int, int> m(1);
+    for (int i = 0; i < 100; ++i) {
+        m.insert_or_assign(i, i);
+    }
+
+    std::thread t1{[&m]() {
+        for (int i = 100; i < 5000; ++i) {
+            m.insert_or_assign(i, i);
+        }
+        for (int i = 100; i < 5000; ++i) {
+            m.erase(i);
+        }
+    }};
+
+    auto reader = [&m]() {
+        executeInLoop<10000>([&m]() {
+            for (int i = 0; i < 100; i += 7) {
+                int v = -1;
+                ASSERT_TRUE(m.find(i, v));
+                ASSERT_EQ(i, v);
+            }
+        });
+    };
+    std::thread t2{reader};
+    std::thread t3{reader};
+
+    t1.join();
+    t2.join();
+    t3.join();
+    ASSERT_EQ(100u, m.size());
+}
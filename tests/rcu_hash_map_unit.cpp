@@ -0,0 +1,74 @@
+#include <rcu_hash_map.hpp>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+struct RcuHashMapCoreTest : public ::testing::Test {};
+
+TEST_F(RcuHashMapCoreTest, empty) {
+    rcu_hash_map<int, int> m;
+    int v = 0;
+    ASSERT_FALSE(m.find(1, v));
+    ASSERT_FALSE(m.contains(1));
+    ASSERT_EQ(0u, m.size());
+    ASSERT_EQ(16u, m.bucket_count());
+}
+
+TEST_F(RcuHashMapCoreTest, insert_or_assign) {
+    rcu_hash_map<int, std::string> m;
+    ASSERT_TRUE(m.insert_or_assign(1, "one"));
+    ASSERT_FALSE(m.insert_or_assign(1, "uno"));
+    ASSERT_TRUE(m.insert_or_assign(2, "two"));
+    ASSERT_EQ(2u, m.size());
+    std::string v;
+    ASSERT_TRUE(m.find(1, v));
+    ASSERT_EQ("uno", v);
+    ASSERT_TRUE(m.find(2, v));
+    ASSERT_EQ("two", v);
+}
+
+TEST_F(RcuHashMapCoreTest, erase) {
+    rcu_hash_map<int, int> m;
+    m.insert_or_assign(1, 1);
+    m.insert_or_assign(17, 17); // same bucket
+    ASSERT_FALSE(m.erase(2));
+    ASSERT_TRUE(m.erase(1));
+    ASSERT_FALSE(m.erase(1));
+    ASSERT_FALSE(m.contains(1));
+    ASSERT_TRUE(m.contains(17));
+    ASSERT_EQ(1u, m.size());
+}
+
+TEST_F(RcuHashMapCoreTest, visit_sees_the_stored_value) {
+    rcu_hash_map<int, std::string> m;
+    m.insert_or_assign(1, "one");
+    std::size_t length = 0;
+    ASSERT_TRUE(m.visit(1, [&length](const std::string& s) {
+        length = s.size();
+    }));
+    ASSERT_EQ(3u, length);
+}
+
+TEST_F(RcuHashMapCoreTest, grows_in_the_background) {
+    rcu_hash_map<int, int> m(4);
+    for (int i = 0; i < 1000; ++i) {
+        m.insert_or_assign(i, i);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        int v = -1;
+        ASSERT_TRUE(m.find(i, v));
+        ASSERT_EQ(i, v);
+    }
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (m.bucket_count() < 1000 &&
+           std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_LE(1000u, m.bucket_count());
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_TRUE(m.contains(i));
+    }
+}
@@ -9,16 +9,62 @@
 
 using asp_traits = jss::atomic_shared_ptr_traits<jss::atomic_shared_ptr>;
 
-template <typename T>
-using rcu_ptr_under_test = rcu_ptr<T, jss::atomic_shared_ptr, asp_traits>;
+template <typename T, typename WritePolicy = detail::multi_writer>
+using rcu_ptr_under_test =
+    rcu_ptr<T, jss::atomic_shared_ptr, asp_traits, WritePolicy>;
+
+#elif defined TEST_WITH_INTRUSIVE_ASP
+
+#include <detail/intrusive_atomic_shared_ptr_traits.hpp>
+
+using asp_traits = detail::intrusive::atomic_shared_ptr_traits<
+    detail::intrusive::atomic_shared_ptr>;
+
+template <typename T, typename WritePolicy = detail::multi_writer>
+using rcu_ptr_under_test =
+    rcu_ptr<T, detail::intrusive::atomic_shared_ptr, asp_traits, WritePolicy>;
+
+#elif defined TEST_WITH_DISTRIBUTED_ASP
+
+#include <detail/distributed_atomic_shared_ptr_traits.hpp>
+
+using asp_traits = detail::distributed::atomic_shared_ptr_traits<
+    detail::distributed::atomic_shared_ptr>;
+
+template <typename T, typename WritePolicy = detail::multi_writer>
+using rcu_ptr_under_test =
+    rcu_ptr<T, detail::distributed::atomic_shared_ptr, asp_traits, WritePolicy>;
+
+#elif defined TEST_WITH_ARENA_ASP
+
+#include <detail/arena_atomic_shared_ptr_traits.hpp>
+
+using asp_traits = detail::arena::atomic_shared_ptr_traits<
+    detail::__std::atomic_shared_ptr>;
+
+template <typename T, typename WritePolicy = detail::multi_writer>
+using rcu_ptr_under_test =
+    rcu_ptr<T, detail::__std::atomic_shared_ptr, asp_traits, WritePolicy>;
+
+#elif defined TEST_WITH_HUGE_PAGE_ASP
+
+#include <detail/huge_page_atomic_shared_ptr_traits.hpp>
+
+using asp_traits = detail::huge_pages::atomic_shared_ptr_traits<
+    detail::__std::atomic_shared_ptr>;
+
+template <typename T, typename WritePolicy = detail::multi_writer>
+using rcu_ptr_under_test =
+    rcu_ptr<T, detail::__std::atomic_shared_ptr, asp_traits, WritePolicy>;
 
 #else
 
 using asp_traits =
     detail::atomic_shared_ptr_traits<detail::__std::atomic_shared_ptr>;
 
-template <typename T>
-using rcu_ptr_under_test = rcu_ptr<T>;
+template <typename T, typename WritePolicy = detail::multi_writer>
+using rcu_ptr_under_test =
+    rcu_ptr<T, detail::__std::atomic_shared_ptr, asp_traits, WritePolicy>;
 
 #endif
 
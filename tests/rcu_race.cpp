@@ -5,6 +5,7 @@
 
 #include <iostream>
 #include <thread>
+#include <vector>
 
 struct RCUPtrRaceTest : public ::testing::Test {};
 
@@ -286,3 +287,50 @@ TEST_F(RCUPtrRaceTest, sum_add) {
     std::cout << x.sum() << std::endl;
     ASSERT_EQ(7000, x.sum());
 }
+
+TEST_F(RCUPtrRaceTest, single_writer_read_copy_update) {
+    rcu_ptr_under_test<int, detail::single_writer> p(
+        asp_traits::make_shared<int>(0));
+
+    std::thread t1{[&p]() {
+        executeInLoop<10000>(
+            [&p]() { p.copy_update([](auto cp) { ++*cp; }); });
+    }};
+
+    int last = 0;
+    executeInLoop<10000>([&p, &last]() {
+        int x = *p.read();
+        ASSERT_LE(last, x);
+        last = x;
+    });
+
+    t1.join();
+
+    ASSERT_EQ(10000, *p.read());
+}
+
+TEST_F(RCUPtrRaceTest, copy_update_merge_of_disjoint_elements) {
+    using V = std::vector<int>;
+    rcu_ptr_under_test<V> p(asp_traits::make_shared<V>(2, 0));
+
+    // Each writer increments its own element and takes the others from the
+    // concurrent writer.
+    auto l = [&p](std::size_t mine) {
+        executeInLoop<10000>([&p, mine]() {
+            p.copy_update_merge(
+                [mine](V* v) { ++(*v)[mine]; },
+                [mine](const V&, V& m, const V& theirs) {
+                    m[1 - mine] = theirs[1 - mine];
+                    return true;
+                });
+        });
+    };
+
+    std::thread t1{l, 0};
+    std::thread t2{l, 1};
+
+    t1.join();
+    t2.join();
+
+    ASSERT_EQ((V{10000, 10000}), *p.read());
+}
@@ -1,6 +1,16 @@
 #include <tests/rcu_ptr_under_test.hpp>
+#include <detail/merge.hpp>
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <map>
+#include <numeric>
+#include <string>
+#include <type_traits>
+#include <vector>
+
 struct RCUPtrCoreTest : public ::testing::Test {};
 
 TEST_F(RCUPtrCoreTest, default_constructible) {
@@ -37,3 +47,348 @@ TEST_F(RCUPtrCoreTest, empty_rcu_ptr_reset_inside_copy_update) {
     ASSERT_TRUE(static_cast<bool>(current));
     ASSERT_EQ(43, *current);
 }
+
+TEST_F(RCUPtrCoreTest, copy_update_of_large_trivially_copyable_value) {
+    using Blob = std::array<int, (1 << 20) / sizeof(int) + 3>;
+    static_assert(detail::is_stream_copyable<Blob>::value, "");
+    auto blob = asp_traits::make_shared<Blob>();
+    for (std::size_t i = 0; i < blob->size(); ++i) {
+        (*blob)[i] = static_cast<int>(i);
+    }
+    rcu_ptr_under_test<Blob> p(blob);
+    p.copy_update([](Blob* b) { (*b)[7] = -1; });
+
+    auto const current = p.read();
+    ASSERT_EQ(-1, (*current)[7]);
+    ASSERT_EQ(7, (*blob)[7]);
+    (*blob)[7] = -1;
+    ASSERT_EQ(*blob, *current);
+}
+
+namespace stream_test {
+// Large and trivially copyable, but not default constructible.
+struct sized_blob {
+    explicit sized_blob(int first) { data[0] = first; }
+    int data[(1 << 20) / sizeof(int) + 1];
+};
+} // namespace stream_test
+
+TEST_F(RCUPtrCoreTest, copy_update_of_large_value_without_default_ctor) {
+    using stream_test::sized_blob;
+    static_assert(std::is_trivially_copyable<sized_blob>::value, "");
+    static_assert(!detail::is_stream_copyable<sized_blob>::value, "");
+    rcu_ptr_under_test<sized_blob> p(asp_traits::make_shared<sized_blob>(1));
+    p.copy_update([](sized_blob* b) { b->data[1] = 2; });
+
+    auto const current = p.read();
+    ASSERT_EQ(1, current->data[0]);
+    ASSERT_EQ(2, current->data[1]);
+}
+
+TEST_F(RCUPtrCoreTest, copy_update_of_vector_with_default_init_allocator) {
+    using V = std::vector<int, detail::default_init_allocator<int> >;
+    for (std::size_t size : {std::size_t(10), std::size_t(1 << 20)}) {
+        auto v = asp_traits::make_shared<V>(size, 1);
+        rcu_ptr_under_test<V> p(v);
+        p.copy_update([](V* c) { c->back() = 2; });
+
+        auto const current = p.read();
+        ASSERT_EQ(size, current->size());
+        ASSERT_EQ(2, current->back());
+        ASSERT_EQ(1, v->back());
+        ASSERT_EQ(1, (*current)[size / 2]);
+    }
+}
+
+TEST_F(RCUPtrCoreTest, stream_copy_any_alignment_and_size) {
+    std::vector<char> src(1000), dst(1200);
+    for (std::size_t i = 0; i < src.size(); ++i) {
+        src[i] = static_cast<char>(i * 7);
+    }
+    std::vector<void (*)(void*, const void*, std::size_t)> copies{
+        detail::stream_copy};
+#ifdef RCU_PTR_STREAM_COPY_X86
+    // Check the variants which the dispatch does not choose, too.
+    copies.push_back([](void* d, const void* s, std::size_t n) {
+        detail::stream::copy_sse2(static_cast<char*>(d),
+                                  static_cast<const char*>(s), n);
+    });
+    if (__builtin_cpu_supports("avx2")) {
+        copies.push_back([](void* d, const void* s, std::size_t n) {
+            detail::stream::copy_avx2(static_cast<char*>(d),
+                                      static_cast<const char*>(s), n);
+        });
+    }
+#endif
+    for (auto copy : copies) {
+        for (std::size_t offset : {0, 1, 13, 64}) {
+            for (std::size_t n : {0, 1, 63, 64, 255, 256, 257, 999}) {
+                std::fill(dst.begin(), dst.end(), 0);
+                copy(dst.data() + offset, src.data() + 1, n);
+                ASSERT_EQ(0,
+                          std::memcmp(dst.data() + offset, src.data() + 1, n));
+                ASSERT_EQ(0, dst[offset + n]);
+            }
+        }
+    }
+}
+
+TEST_F(RCUPtrCoreTest, parallel_copy_update_of_large_blob) {
+    struct blob {
+        char bytes[9 << 20];
+    };
+    auto b = asp_traits::make_shared<blob>();
+    std::fill(std::begin(b->bytes), std::end(b->bytes), 'a');
+    rcu_ptr_under_test<blob> p(b);
+    p.parallel_copy_update([](blob* c) { c->bytes[0] = 'b'; },
+                           detail::thread_executor(3));
+
+    auto const current = p.read();
+    ASSERT_EQ('b', current->bytes[0]);
+    ASSERT_EQ('a', b->bytes[0]);
+    ASSERT_TRUE(std::all_of(current->bytes + 1, std::end(current->bytes),
+                            [](char c) { return c == 'a'; }));
+}
+
+TEST_F(RCUPtrCoreTest, parallel_copy_update_of_vectors) {
+    using V = std::vector<int, detail::default_init_allocator<int> >;
+    auto v = asp_traits::make_shared<V>(3 << 20);
+    std::iota(v->begin(), v->end(), 0);
+    rcu_ptr_under_test<V> p(v);
+    p.parallel_copy_update([](V* c) { c->push_back(-1); });
+
+    auto const current = p.read();
+    ASSERT_EQ(v->size() + 1, current->size());
+    ASSERT_TRUE(std::equal(v->begin(), v->end(), current->begin()));
+
+    using N = std::vector<std::vector<int> >;
+    rcu_ptr_under_test<N> n(asp_traits::make_shared<N>(100));
+    n.parallel_copy_update([](N* c) { (*c)[42].push_back(42); });
+    n.parallel_copy_update([](N* c) { (*c)[43].push_back(43); },
+                           detail::thread_executor(4));
+
+    auto const nested = n.read();
+    ASSERT_EQ(100u, nested->size());
+    ASSERT_EQ(std::vector<int>{42}, (*nested)[42]);
+    ASSERT_EQ(std::vector<int>{43}, (*nested)[43]);
+    ASSERT_TRUE((*nested)[0].empty());
+}
+
+namespace {
+// Runs the chunks on the calling thread and counts the split copies.
+struct counting_executor {
+    int splits = 0;
+    std::size_t concurrency() const { return 4; }
+    template <typename F>
+    void parallel_for(std::size_t n, F&& f) {
+        ++splits;
+        for (std::size_t i = 0; i < n; ++i) {
+            f(i);
+        }
+    }
+};
+} // namespace
+
+TEST_F(RCUPtrCoreTest, parallel_copy_update_splits_large_copies_only) {
+    counting_executor executor;
+    using S = std::vector<std::string>;
+    rcu_ptr_under_test<S> small(asp_traits::make_shared<S>(9, "abc"));
+    small.parallel_copy_update([](S* s) { s->front() = "x"; }, executor);
+    ASSERT_EQ("x", small.read()->front());
+    ASSERT_EQ(0, executor.splits);
+
+    // It would be zeroed before the copy.
+    using Z = std::vector<int>;
+    rcu_ptr_under_test<Z> zeroed(asp_traits::make_shared<Z>(3 << 20, 1));
+    zeroed.parallel_copy_update([](Z* z) { z->back() = 2; }, executor);
+    ASSERT_EQ(2, zeroed.read()->back());
+    ASSERT_EQ(0, executor.splits);
+
+    using N = std::vector<std::vector<int> >;
+    std::size_t n = (9 << 20) / sizeof(std::vector<int>);
+    rcu_ptr_under_test<N> nested(asp_traits::make_shared<N>(n));
+    nested.parallel_copy_update([](N* c) { c->back().push_back(1); },
+                                executor);
+    ASSERT_EQ(std::vector<int>{1}, nested.read()->back());
+    ASSERT_EQ(1, executor.splits);
+}
+
+namespace stream_test {
+struct huge_sized_blob {
+    explicit huge_sized_blob(int first) { data[0] = first; }
+    int data[(9 << 20) / sizeof(int)];
+};
+} // namespace stream_test
+
+TEST_F(RCUPtrCoreTest, parallel_copy_update_of_value_without_default_ctor) {
+    using stream_test::huge_sized_blob;
+    rcu_ptr_under_test<huge_sized_blob> p(
+        asp_traits::make_shared<huge_sized_blob>(1));
+    counting_executor executor;
+    p.parallel_copy_update([](huge_sized_blob* b) { b->data[1] = 2; },
+                           executor);
+    ASSERT_EQ(1, p.read()->data[0]);
+    ASSERT_EQ(2, p.read()->data[1]);
+    ASSERT_EQ(0, executor.splits);
+}
+
+TEST_F(RCUPtrCoreTest, single_writer_copy_update_and_reset) {
+    using V = std::vector<int>;
+    rcu_ptr_under_test<V, detail::single_writer> p(
+        asp_traits::make_shared<V>());
+    int calls = 0;
+    p.copy_update([&calls](V* v) {
+        v->push_back(1);
+        ++calls;
+    });
+    ASSERT_EQ(1, calls);
+    ASSERT_EQ(V{1}, *p.read());
+
+    p.reset(asp_traits::make_shared<V>(V{7}));
+    p.copy_update([](V* v) { v->push_back(8); });
+    ASSERT_EQ((V{7, 8}), *p.read());
+
+    rcu_ptr_under_test<V, detail::single_writer> empty;
+    empty.copy_update([](V* v) { ASSERT_EQ(nullptr, v); });
+    ASSERT_FALSE(empty.read());
+}
+
+#ifndef NDEBUG
+TEST_F(RCUPtrCoreTest, single_writer_detects_concurrent_writer) {
+    rcu_ptr_under_test<int, detail::single_writer> p(
+        asp_traits::make_shared<int>(0));
+    // A write from within a write overlaps like a write of another thread.
+    ASSERT_DEATH(p.copy_update([&p](int*) { p.copy_update([](int*) {}); }),
+                 "during another");
+    auto reset_inside = [&p](int*) {
+        p.reset(asp_traits::make_shared<int>(1));
+    };
+    ASSERT_DEATH(p.copy_update(reset_inside), "from the lambda of");
+}
+#endif
+
+namespace clone_test {
+
+// Copying it copies its large member, rcu_clone shares it.
+struct document {
+    std::shared_ptr<const std::vector<int> > body;
+    int revision = 0;
+    static int deep_copies;
+
+    explicit document(std::vector<int> b)
+        : body(std::make_shared<const std::vector<int> >(std::move(b))) {}
+    document(const document& other)
+        : body(std::make_shared<const std::vector<int> >(*other.body)),
+          revision(other.revision) {
+        ++deep_copies;
+    }
+    document(document&&) = default;
+
+    struct shallow_t {};
+    document(shallow_t, const document& other)
+        : body(other.body), revision(other.revision) {}
+};
+
+int document::deep_copies = 0;
+
+document rcu_clone(const document& d) {
+    return document(document::shallow_t(), d);
+}
+
+} // namespace clone_test
+
+TEST_F(RCUPtrCoreTest, copy_update_uses_rcu_clone) {
+    using clone_test::document;
+    static_assert(detail::has_rcu_clone<document>::value, "");
+    static_assert(!detail::has_rcu_clone<std::vector<int> >::value, "");
+
+    rcu_ptr_under_test<document> p(
+        asp_traits::make_shared<document>(std::vector<int>(1000, 1)));
+    auto const original = p.read();
+    p.copy_update([](document* d) { ++d->revision; });
+    p.parallel_copy_update([](document* d) { ++d->revision; });
+
+    auto const current = p.read();
+    ASSERT_EQ(2, current->revision);
+    ASSERT_EQ(0, original->revision);
+    ASSERT_EQ(original->body, current->body);
+    ASSERT_EQ(0, document::deep_copies);
+}
+
+TEST_F(RCUPtrCoreTest, copy_update_merge_merges_instead_of_calling_again) {
+    using V = std::vector<int>;
+    rcu_ptr_under_test<V> p(asp_traits::make_shared<V>(V{0, 0}));
+    int calls = 0, merges = 0;
+    p.copy_update_merge(
+        [&](V* v) {
+            ++calls;
+            (*v)[0] = 1;
+            // A concurrent writer publishes before this update does.
+            p.copy_update([](V* w) { (*w)[1] = 2; });
+        },
+        [&](const V& base, V& mine, const V& theirs) {
+            ++merges;
+            EXPECT_EQ((V{0, 0}), base);
+            EXPECT_EQ((V{1, 0}), mine);
+            EXPECT_EQ((V{0, 2}), theirs);
+            mine[1] = theirs[1];
+            return true;
+        });
+    ASSERT_EQ(1, calls);
+    ASSERT_EQ(1, merges);
+    ASSERT_EQ((V{1, 2}), *p.read());
+}
+
+TEST_F(RCUPtrCoreTest, copy_update_merge_starts_over_on_conflict) {
+    using M = std::map<int, int>;
+    rcu_ptr_under_test<M> p(asp_traits::make_shared<M>(M{{1, 0}, {2, 0}}));
+    auto update = [&](int key, int concurrent_key) {
+        int calls = 0;
+        p.copy_update_merge(
+            [&](M* m) {
+                ++(*m)[key];
+                if (calls++ == 0) {
+                    p.copy_update([&](M* w) { (*w)[concurrent_key] += 5; });
+                }
+            },
+            detail::merge_keys(std::vector<int>{key}));
+        return calls;
+    };
+    // Disjoint keys merge.
+    ASSERT_EQ(1, update(1, 2));
+    ASSERT_EQ((M{{1, 1}, {2, 5}}), *p.read());
+    // New keys of the concurrent writer merge too.
+    ASSERT_EQ(1, update(1, 3));
+    ASSERT_EQ((M{{1, 2}, {2, 5}, {3, 5}}), *p.read());
+    // The same key does not.
+    ASSERT_EQ(2, update(2, 2));
+    ASSERT_EQ((M{{1, 2}, {2, 11}, {3, 5}}), *p.read());
+}
+
+namespace merge_test {
+struct stats {
+    long count = 0;
+    long sum = 0;
+    std::vector<int> samples;
+};
+} // namespace merge_test
+
+TEST_F(RCUPtrCoreTest, copy_update_merge_of_fields) {
+    using merge_test::stats;
+    rcu_ptr_under_test<stats> p(asp_traits::make_shared<stats>());
+    int calls = 0;
+    auto merge = detail::merge_fields(&stats::count, &stats::sum);
+    p.copy_update_merge(
+        [&](stats* s) {
+            ++calls;
+            ++s->count;
+            s->sum += 10;
+            p.copy_update([](stats* w) { w->samples.push_back(10); });
+        },
+        merge);
+    ASSERT_EQ(1, calls);
+    auto const current = p.read();
+    ASSERT_EQ(1, current->count);
+    ASSERT_EQ(10, current->sum);
+    ASSERT_EQ(std::vector<int>{10}, current->samples);
+}
@@ -0,0 +1,180 @@
+#include <shm_rcu_ptr.hpp>
+
+#include <gtest/gtest.h>
+
+#include <csignal>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <string>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+struct table {
+    using allocator_type = shm_allocator<char>;
+
+    std::uint64_t version = 0;
+    shm_array<int> values;
+
+    table(std::allocator_arg_t, const allocator_type& a, std::size_t n)
+        : values(std::allocator_arg, a, n) {
+        std::iota(values.begin(), values.end(), 0);
+    }
+
+    table(std::allocator_arg_t, const allocator_type& a, const table& other)
+        : version(other.version), values(std::allocator_arg, a, other.values) {}
+
+    long sum() const {
+        return std::accumulate(values.begin(), values.end(), 0L);
+    }
+};
+
+using shm_table = shm_rcu_ptr<table>;
+
+// A pipe to synchronize with a child process.
+struct channel {
+    int fds[2];
+    channel() {
+        if (::pipe(fds) != 0) throw std::runtime_error("pipe");
+    }
+    ~channel() {
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+    void signal() {
+        char c = 1;
+        ASSERT_EQ(1, ::write(fds[1], &c, 1));
+    }
+    void wait() {
+        char c;
+        ASSERT_EQ(1, ::read(fds[0], &c, 1));
+    }
+};
+
+// Runs fun in a child process, returns the pid.
+template <typename F>
+pid_t spawn(F fun) {
+    pid_t pid = ::fork();
+    if (pid == 0) {
+        int code = 1;
+        try {
+            code = fun() ? 0 : 1;
+        } catch (...) {
+        }
+        ::_exit(code);
+    }
+    return pid;
+}
+
+// Returns the exit code of the child, -1 if it did not exit normally.
+int join(pid_t pid) {
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+} // namespace
+
+struct ShmRcuPtrTest : public ::testing::Test {
+    const std::string name =
+        "/rcu_ptr_test_" + std::to_string(::getpid()) + "_" +
+        ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    std::unique_ptr<shm_table> writer;
+
+    void SetUp() override {
+        shm_table::remove(name);
+        writer.reset(new shm_table(name, 8 << 20, 4));
+    }
+    void TearDown() override { shm_table::remove(name); }
+
+    void increment_all() {
+        writer->copy_update([](table* t, shm_table::allocator_type&) {
+            ++t->version;
+            for (int& v : t->values) {
+                ++v;
+            }
+        });
+    }
+};
+
+TEST_F(ShmRcuPtrTest, readers_in_other_processes_see_versions) {
+    shm_table::reader local(name);
+    ASSERT_FALSE(local.read());
+
+    writer->emplace(std::size_t(1000));
+    increment_all();
+    long expected = 1000L * 999 / 2 + 1000;
+    ASSERT_EQ(expected, writer->get()->sum());
+    // The reader maps the segment at another address.
+    ASSERT_EQ(expected, local.read()->sum());
+
+    pid_t child = spawn([&]() {
+        shm_table::reader r(name);
+        auto s = r.read();
+        return s->version == 1 && s->sum() == expected;
+    });
+    ASSERT_EQ(0, join(child));
+}
+
+TEST_F(ShmRcuPtrTest, pinned_versions_are_kept_until_released) {
+    writer->emplace(std::size_t(100000));
+    std::size_t one_version = writer->used_pages();
+    channel ready, go;
+    pid_t child = spawn([&]() {
+        shm_table::reader r(name);
+        auto s = r.read();
+        long before = s->sum();
+        ready.signal();
+        go.wait();
+        return s->version == 0 && s->sum() == before;
+    });
+    ready.wait();
+    for (int i = 0; i < 3; ++i) {
+        increment_all();
+    }
+    // The version of the child and the current one.
+    ASSERT_EQ(1u, writer->retired());
+    ASSERT_EQ(2 * one_version, writer->used_pages());
+    go.signal();
+    ASSERT_EQ(0, join(child));
+
+    ASSERT_EQ(0u, writer->reclaim());
+    ASSERT_EQ(one_version, writer->used_pages());
+}
+
+TEST_F(ShmRcuPtrTest, versions_of_crashed_readers_are_reclaimed) {
+    writer->emplace(std::size_t(1000));
+    channel ready, never;
+    pid_t child = spawn([&]() {
+        shm_table::reader r(name);
+        auto s = r.read();
+        ready.signal();
+        never.wait();
+        return true;
+    });
+    ready.wait();
+    increment_all();
+    ASSERT_EQ(1u, writer->retired());
+
+    ::kill(child, SIGKILL);
+    ASSERT_EQ(-1, join(child));
+    ASSERT_EQ(0u, writer->reclaim());
+
+    // Its slot is free again.
+    std::vector<std::unique_ptr<shm_table::reader>> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back(new shm_table::reader(name));
+    }
+    ASSERT_THROW(shm_table::reader extra(name), std::runtime_error);
+}
+
+TEST_F(ShmRcuPtrTest, full_segment_keeps_current_version) {
+    writer->emplace(std::size_t(1000));
+    ASSERT_THROW(writer->emplace(std::size_t(16) << 20), std::bad_alloc);
+    ASSERT_EQ(0u, writer->get()->version);
+    ASSERT_THROW(shm_rcu_ptr<int>::reader wrong_type(name), std::runtime_error);
+    ASSERT_THROW(shm_table duplicate(name, 1 << 20), std::system_error);
+}